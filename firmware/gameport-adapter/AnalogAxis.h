@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include "AxisLimits.h"
+#include "Config.h"
 #include <Arduino.h>
 
 /// Class to read analog axis.
@@ -24,19 +26,41 @@
 /// many analog joysticks have old, bad, or just wrong resistors. This ends
 /// up in incorrect positions and is especially bad for games, which don't
 /// have calibration features. This class takes care of this issue and
-/// applies automatic calibration on every read.
+/// applies automatic calibration on every read. The mapping factors are
+/// recalculated only, when the limits change.
 template <int ID>
 class AnalogAxis {
 public:
   /// Constructor.
   ///
-  /// The initial state of the joystick is considered as middle
-  /// which is used for autocalibration.
+  /// The axis is not read here, which would block the startup. It has
+  /// to be calibrated before the first use.
   AnalogAxis() {
     pinMode(ID, INPUT);
-    m_mid = analogRead(ID);
-    m_min = m_mid - 100;
-    m_max = m_mid + 100;
+  }
+
+  /// Starts the calibration.
+  ///
+  /// The current state of the joystick is considered as middle
+  /// which is used for autocalibration.
+  void calibrate() {
+    const int window = Config::get().analogWindow;
+    m_value = analogRead(ID);
+    m_mid = m_value;
+    m_innerMin = max(m_mid - window, 0);
+    m_innerMax = min(m_mid + window, 1023);
+    m_limits.reset(m_innerMin, m_innerMax);
+    updateScales();
+  }
+
+  /// Checks if a potentiometer is connected to the axis.
+  ///
+  /// The adapter pulls every axis to the ground, so without a joystick
+  /// the value stays close to zero. With a joystick, even at the highest
+  /// resistance of the potentiometer, it is about the half of the range.
+  /// @remark this check is based on the last read value
+  bool isConnected() const {
+    return m_value > 128;
   }
 
   /// Gets the axis state.
@@ -45,21 +69,31 @@ public:
   /// readjusts the position of the joystick.
   /// @returns a value between 0 and 1023
   uint16_t get() {
-    const auto value = analogRead(ID);
-    if (value < m_min) {
-      m_min = value;
-    } else if (value > m_max) {
-      m_max = value;
+    m_value = analogRead(ID);
+    if (m_limits.update(m_value, m_innerMin, m_innerMax)) {
+      updateScales();
     }
 
+    const auto value = m_limits.clamp(m_value);
     if (value < m_mid) {
-      return map(value, m_min, m_mid, 1023, 512);
+      return 1023u - (uint32_t(value - m_limits.getMin()) * m_scaleLow >> SCALE_BITS);
     }
-    return map(value, m_mid, m_max, 511, 0);
+    return 511u - (uint32_t(value - m_mid) * m_scaleHigh >> SCALE_BITS);
   }
 
 private:
-  int m_mid;
-  int m_min;
-  int m_max;
+  static const uint8_t SCALE_BITS{16};
+
+  int m_value{};
+  int m_mid{};
+  uint16_t m_innerMin{};
+  uint16_t m_innerMax{};
+  AxisLimits m_limits;
+  uint32_t m_scaleLow{};
+  uint32_t m_scaleHigh{};
+
+  void updateScales() {
+    m_scaleLow = AxisLimits::getScale(511u, m_mid - m_limits.getMin(), SCALE_BITS);
+    m_scaleHigh = AxisLimits::getScale(511u, m_limits.getMax() - m_mid, SCALE_BITS);
+  }
 };
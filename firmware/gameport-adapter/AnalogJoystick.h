@@ -17,17 +17,117 @@
 #pragma once
 
 #include "AnalogAxis.h"
+#include "AxisFilter.h"
+#include "Config.h"
+#include "Debouncer.h"
 #include "DigitalPin.h"
 #include "GamePort.h"
 
 /// A common class for all analog joysticks.
+///
+/// Reading the buttons is just a register read, but every axis needs an
+/// ADC conversion of about 110us. So the axes are sampled with a lower
+/// rate than the buttons. Every update converts only some of the axes,
+/// round robin, while the others keep their last value. Every axis has its
+/// own filter against the jitter of worn potentiometers, which is disabled
+/// by default.
 class AnalogJoystick {
 public:
-  /// Gets axis value.
+  static const uint8_t NUM_AXES{4};
+
+  /// Number of axes converted per update.
+  ///
+  /// Increase for fresher axes, decrease for lower button latency.
+  static const uint8_t AXES_PER_UPDATE{2};
+
+  /// Recalibrates the axes.
+  ///
+  /// @returns true if a joystick is connected
+  bool init() {
+    m_axis1.calibrate();
+    m_axis2.calibrate();
+    m_axis3.calibrate();
+    m_axis4.calibrate();
+    for (auto i = 0u; i < NUM_AXES; i++) {
+      m_values[i] = readAxis(i);
+      m_filters[i].reset(m_values[i]);
+    }
+    return isConnected();
+  }
+
+  /// Converts the next axes.
+  ///
+  /// @param[in] used is a bit mask of the axes used by the joystick
+  void sampleAxes(uint8_t used) {
+    const auto &config = Config::get();
+    const AxisFilter::Parameters params{config.axisAlpha, config.axisBeta, config.axisMaxLag};
+    for (auto n = 0u; n < AXES_PER_UPDATE; n++) {
+      for (auto i = 0u; i < NUM_AXES; i++) {
+        m_next = (m_next + 1u) % NUM_AXES;
+        if (used & (1u << m_next)) {
+          break;
+        }
+      }
+      if (!(used & (1u << m_next))) {
+        return;
+      }
+      m_values[m_next] = m_filters[m_next].update(readAxis(m_next), params);
+    }
+  }
+
+  /// Checks if a joystick is connected.
+  ///
+  /// Every analog joystick has at least the X and Y axes, so at least one
+  /// of them has to be connected.
+  /// @remark this check is based on the last read values of the axes
+  bool isConnected() const {
+    return m_axis1.isConnected() || m_axis2.isConnected();
+  }
+
+  /// Checks if the second joystick of a Y cable is connected.
+  ///
+  /// @see isConnected() for the first one
+  bool isSecondConnected() const {
+    return m_axis3.isConnected() || m_axis4.isConnected();
+  }
+
+  /// Gets the last sampled axis value.
   ///
   /// @param[in] id is the axes ID
-  /// @returns a value between 0 and 255
-  uint16_t getAxis(int id) {
+  /// @returns a value between 0 and 1023
+  uint16_t getAxis(int id) const {
+    return id < NUM_AXES ? m_values[id] : 0u;
+  }
+
+  /// Gets the debounced buttons state as one byte.
+  ///
+  /// @returns a byte every bit represents a button
+  byte getButtons() {
+    return m_debouncer.update(readButtons());
+  }
+
+  /// Reads the raw buttons state as one byte.
+  ///
+  /// Joysticks, which encode the buttons as codes, have to filter the
+  /// codes on their own. Debouncing every line separately would mix up
+  /// the bits of different codes.
+  /// @returns a byte every bit represents a button
+  byte readButtons() const {
+    return ~m_buttons.read() & 0x0f;
+  }
+
+private:
+  PinGroup<GamePort<2>::pin, GamePort<7>::pin, GamePort<10>::pin, GamePort<14>::pin> m_buttons;
+  AnalogAxis<GamePort<3>::pin> m_axis1;
+  AnalogAxis<GamePort<6>::pin> m_axis2;
+  AnalogAxis<GamePort<11>::pin> m_axis3;
+  AnalogAxis<GamePort<13>::pin> m_axis4;
+  uint16_t m_values[NUM_AXES]{};
+  AxisFilter m_filters[NUM_AXES];
+  uint8_t m_next{};
+  Debouncer<> m_debouncer;
+
+  uint16_t readAxis(int id) {
     switch (id) {
       case 0:
         return m_axis1.get();
@@ -41,21 +141,4 @@ public:
         return 0u;
     }
   }
-
-  /// Gets the buttons state as one byte.
-  ///
-  /// @returns a byte every bit represents a button
-  byte getButtons() {
-    return m_button1.isLow() | m_button2.isLow() << 1 | m_button3.isLow() << 2 | m_button4.isLow() << 3;
-  }
-
-private:
-  DigitalInput<GamePort<2>::pin> m_button1;
-  DigitalInput<GamePort<7>::pin> m_button2;
-  DigitalInput<GamePort<10>::pin> m_button3;
-  DigitalInput<GamePort<14>::pin> m_button4;
-  AnalogAxis<GamePort<3>::pin> m_axis1;
-  AnalogAxis<GamePort<6>::pin> m_axis2;
-  AnalogAxis<GamePort<11>::pin> m_axis3;
-  AnalogAxis<GamePort<13>::pin> m_axis4;
 };
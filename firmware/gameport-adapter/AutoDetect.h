@@ -0,0 +1,178 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Flash.h"
+#include "GamePort.h"
+#include "GrIP.h"
+#include "Logitech.h"
+#include "Sidewinder.h"
+#include "Utilities.h"
+#include <EEPROM.h>
+
+/// Drivers as selected by the DIP switches.
+enum class Driver : uint8_t {
+  generic_2_2 = 0b0000,
+  generic_2_4 = 0b0001,
+  generic_3_4 = 0b0010,
+  generic_4_4 = 0b0011,
+  ch_flightstick_pro = 0b0100,
+  thrustmaster = 0b0101,
+  ch_f16_combat_stick = 0b0110,
+  sidewinder = 0b0111,
+  grip = 0b1000,
+  logitech = 0b1001,
+  dual_2_2 = 0b1010,
+  autodetect = 0b1111,
+};
+
+/// Automatic protocol detection.
+///
+/// The digital protocols are probed first, because many digital devices,
+/// like the Sidewinder 3D Pro or the Logitech ADI devices, start up in an
+/// analog compatible mode. The passive GrIP probe comes first. Sidewinder
+/// and ADI probes drive the trigger line (X axis), so they are skipped, if
+/// that line looks like a potentiometer turned to the end, which would be
+/// shorted by the output. If no digital device answers, the analog axes
+/// are counted. Every probe runs only if its worst case duration still
+/// fits into the total time budget.
+///
+/// A detected digital driver is cached in EEPROM and is probed first on
+/// the next boot. Analog results are not cached, because a digital device
+/// in analog mode would be detected as analog joystick as well.
+class AutoDetect {
+public:
+  /// Detects the driver of the connected device.
+  /// @returns the detected driver, but never Driver::autodetect
+  static Driver detect() {
+    const auto start = millis();
+
+    const auto cached = readCache();
+    if (cached != Driver::autodetect && probe(cached, start)) {
+      log("Cached driver %d confirmed", int(cached));
+      return cached;
+    }
+
+    static const Driver drivers[] PROGMEM = {Driver::grip, Driver::sidewinder, Driver::logitech};
+    for (const auto &entry : drivers) {
+      const auto driver = Flash::read(entry);
+      if (driver != cached && probe(driver, start)) {
+        log("Detected driver %d", int(driver));
+        writeCache(driver);
+        return driver;
+      }
+    }
+
+    return probeAnalog();
+  }
+
+private:
+  /// Total time budget in milliseconds.
+  static const uint16_t BUDGET{250u};
+
+  /// EEPROM layout of the detection cache.
+  static const int CACHE_ADDRESS{0};
+  static const uint8_t CACHE_MAGIC{0xA5};
+
+  /// Analog values above this level mean a connected axis.
+  static const int AXIS_THRESHOLD{128};
+
+  /// Analog values above this level mean the line is tied to VCC.
+  static const int SHORTED_THRESHOLD{1000};
+
+  static Driver readCache() {
+    if (EEPROM.read(CACHE_ADDRESS) != CACHE_MAGIC) {
+      return Driver::autodetect;
+    }
+    return Driver(EEPROM.read(CACHE_ADDRESS + 1));
+  }
+
+  static void writeCache(Driver driver) {
+    EEPROM.update(CACHE_ADDRESS, CACHE_MAGIC);
+    EEPROM.update(CACHE_ADDRESS + 1, uint8_t(driver));
+  }
+
+  /// Gets the worst case probe duration in milliseconds.
+  static uint16_t getCost(Driver driver) {
+    switch (driver) {
+      case Driver::grip:
+        return 15u;
+      case Driver::sidewinder:
+        return 50u;
+      case Driver::logitech:
+        return 180u;
+      default:
+        return 0u;
+    }
+  }
+
+  static bool isTriggerSafe() {
+    return analogRead(GamePort<3>::pin) < SHORTED_THRESHOLD;
+  }
+
+  /// Releases the trigger line driven by the active probes.
+  static void releaseTrigger() {
+    pinMode(GamePort<3>::pin, INPUT);
+  }
+
+  static bool probe(Driver driver, unsigned long start) {
+    if (millis() - start + getCost(driver) > BUDGET) {
+      return false;
+    }
+
+    switch (driver) {
+      case Driver::grip:
+        return GrIP{}.probe();
+      case Driver::sidewinder: {
+        if (!isTriggerSafe()) {
+          return false;
+        }
+        const auto result = Sidewinder{}.probe();
+        releaseTrigger();
+        return result;
+      }
+      case Driver::logitech: {
+        if (!isTriggerSafe()) {
+          return false;
+        }
+        const auto result = Logitech{}.probe();
+        releaseTrigger();
+        return result;
+      }
+      default:
+        return false;
+    }
+  }
+
+  static Driver probeAnalog() {
+    const auto connected = [](int pin) {
+      pinMode(pin, INPUT);
+      return analogRead(pin) > AXIS_THRESHOLD;
+    };
+
+    if (!connected(GamePort<3>::pin) || !connected(GamePort<6>::pin)) {
+      return Driver::generic_2_2;
+    }
+    if (!connected(GamePort<11>::pin)) {
+      return Driver::generic_2_4;
+    }
+    if (!connected(GamePort<13>::pin)) {
+      return Driver::generic_3_4;
+    }
+    return Driver::generic_4_4;
+  }
+};
@@ -0,0 +1,91 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+
+/// Alpha-beta filter for analog axes.
+///
+/// Worn potentiometers jitter, but averaging the samples delays every
+/// movement. This filter tracks the position and the velocity of the axis.
+/// Every sample is compared with the predicted position and both estimates
+/// are corrected by fixed fractions of the difference. Steady movements are
+/// followed without a constant lag, while the noise is damped. Sudden jumps
+/// are never smoothed away: if the output would be further away from the
+/// sample than a maximum distance, the filter restarts at the sample.
+/// Otherwise the velocity gained on the jump would overshoot the target.
+///
+/// The estimates are fixed point numbers with FRACTION_BITS fractional bits.
+class AxisFilter {
+public:
+  /// Tuning of the filter.
+  struct Parameters {
+    /// Position correction in 1/256, lower values damp more noise, 0 disables the filter.
+    uint8_t alpha;
+    /// Velocity correction in 1/256, lower values react slower to movements.
+    uint8_t beta;
+    /// Maximum distance between the output and the sample, larger jumps restart the filter.
+    uint8_t maxLag;
+  };
+
+  /// Largest axis value.
+  static const uint16_t MAX_VALUE{1023u};
+
+  /// Restarts the filter at the given value.
+  void reset(uint16_t value) {
+    m_position = int32_t(value) << FRACTION_BITS;
+    m_velocity = 0;
+  }
+
+  /// Adds a new sample of the axis.
+  /// @param[in] sample is the raw axis value
+  /// @param[in] params is the tuning of the filter
+  /// @returns the filtered axis value
+  uint16_t update(uint16_t sample, const Parameters &params) {
+    if (!params.alpha) {
+      reset(sample);
+      return sample;
+    }
+
+    const auto measured = int32_t(sample) << FRACTION_BITS;
+    const auto predicted = m_position + m_velocity;
+    const auto residual = measured - predicted;
+    m_position = predicted + scale(residual, params.alpha);
+    m_velocity += scale(residual, params.beta);
+
+    const auto limit = int32_t(params.maxLag) << FRACTION_BITS;
+    if (m_position > measured + limit || m_position < measured - limit) {
+      reset(sample);
+      return sample;
+    }
+
+    const auto value = (m_position + HALF) >> FRACTION_BITS;
+    return constrain(value, 0, int32_t(MAX_VALUE));
+  }
+
+private:
+  static const uint8_t FRACTION_BITS{6};
+  static const int32_t HALF{1 << (FRACTION_BITS - 1)};
+
+  int32_t m_position{};
+  int32_t m_velocity{};
+
+  /// Multiplies the value with a factor in 1/256 and rounds the result.
+  static int32_t scale(int32_t value, uint8_t factor) {
+    return (value * factor + 128) >> 8;
+  }
+};
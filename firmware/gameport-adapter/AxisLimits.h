@@ -0,0 +1,152 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+
+/// Adaptive limits of an axis for the automatic calibration.
+///
+/// A single electrical spike must not widen the limits, otherwise the
+/// usable range stays compressed until the next reset. So a sample beyond
+/// the limits is held back, until CONFIRM_SAMPLES of them are seen in a
+/// row. The limit is then moved to the least extreme of them.
+///
+/// A wrongly confirmed extreme has to fade out, but the limits must not
+/// creep in, while the stick is only deflected partially for a while. So
+/// the most extreme accepted samples are held as peaks over two periods of
+/// PEAK_SAMPLES. Every DECAY_SAMPLES samples a limit moves back by one step,
+/// but only towards the held peak and never into the inner range. A limit,
+/// which was reached during the last two periods, doesn't move at all.
+class AxisLimits {
+public:
+  /// Number of consecutive samples to confirm a new extreme.
+  static const uint8_t CONFIRM_SAMPLES{3};
+  static_assert(CONFIRM_SAMPLES < 4, "Confirm samples don't fit into the counter");
+
+  /// Number of samples, after which the limits decay by one step.
+  static const uint16_t DECAY_SAMPLES{2048};
+
+  /// Number of samples, over which the peaks are held, as long as the counter allows.
+  static const uint16_t PEAK_SAMPLES{31 * DECAY_SAMPLES};
+
+  AxisLimits()
+  : m_count(0u)
+  , m_above(false) {
+  }
+
+  /// Sets the limits.
+  void reset(uint16_t min, uint16_t max) {
+    m_min = min;
+    m_max = max;
+    m_count = 0u;
+    m_peakMin = m_heldMin = NO_PEAK_MIN;
+    m_peakMax = m_heldMax = NO_PEAK_MAX;
+    m_samples = 0u;
+  }
+
+  /// Adds a new sample of the axis.
+  /// @param[in] value is the raw axis value
+  /// @param[in] innerMin is the lowest value, the minimum can decay to
+  /// @param[in] innerMax is the highest value, the maximum can decay to
+  /// @returns true, if the limits have changed
+  bool update(uint16_t value, uint16_t innerMin, uint16_t innerMax) {
+    auto changed = false;
+
+    if (value < m_min || value > m_max) {
+      const bool above = value > m_max;
+      if (m_count == 0u || above != m_above) {
+        m_count = 0u;
+        m_above = above;
+        m_pending = value;
+      } else {
+        m_pending = above ? min(m_pending, value) : max(m_pending, value);
+      }
+      if (++m_count >= CONFIRM_SAMPLES) {
+        (above ? m_max : m_min) = m_pending;
+        m_count = 0u;
+        changed = true;
+      }
+    } else {
+      m_count = 0u;
+    }
+
+    if (value >= m_min && value <= m_max) {
+      m_peakMin = min(m_peakMin, value);
+      m_peakMax = max(m_peakMax, value);
+    }
+
+    if (++m_samples % DECAY_SAMPLES == 0u) {
+      if (m_min < min(min(m_peakMin, m_heldMin), innerMin)) {
+        m_min++;
+        changed = true;
+      }
+      if (m_max > max(max(m_peakMax, m_heldMax), innerMax)) {
+        m_max--;
+        changed = true;
+      }
+      if (m_samples >= PEAK_SAMPLES) {
+        m_heldMin = m_peakMin;
+        m_heldMax = m_peakMax;
+        m_peakMin = NO_PEAK_MIN;
+        m_peakMax = NO_PEAK_MAX;
+        m_samples = 0u;
+      }
+    }
+
+    return changed;
+  }
+
+  /// Limits the value to the current range.
+  uint16_t clamp(uint16_t value) const {
+    return value < m_min ? m_min : value > m_max ? m_max : value;
+  }
+
+  uint16_t getMin() const {
+    return m_min;
+  }
+
+  uint16_t getMax() const {
+    return m_max;
+  }
+
+  /// Calculates the fixed point factor to map a span to a range.
+  ///
+  /// The factor is rounded up, so the end of the span maps exactly to the
+  /// end of the range. Mapping a value then needs just a multiplication.
+  /// @param[in] range is the largest mapped value
+  /// @param[in] span is the distance between the limits
+  /// @param[in] bits is the number of fractional bits of the factor
+  static uint32_t getScale(uint16_t range, uint16_t span, uint8_t bits) {
+    span = max(span, uint16_t(1u));
+    return ((uint32_t(range) << bits) + span - 1u) / span;
+  }
+
+private:
+  static const uint16_t NO_PEAK_MIN{0xffffu};
+  static const uint16_t NO_PEAK_MAX{0u};
+
+  uint16_t m_min{};
+  uint16_t m_max{};
+  uint16_t m_pending{};
+  uint16_t m_peakMin{NO_PEAK_MIN};
+  uint16_t m_peakMax{NO_PEAK_MAX};
+  uint16_t m_heldMin{NO_PEAK_MIN};
+  uint16_t m_heldMax{NO_PEAK_MAX};
+  uint16_t m_samples{};
+  uint8_t m_count : 2;
+  bool m_above : 1;
+};
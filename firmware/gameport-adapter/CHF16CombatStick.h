@@ -17,14 +17,18 @@
 #pragma once
 
 #include "AnalogJoystick.h"
+#include "CodeFilter.h"
+#include "Flash.h"
 #include "Joystick.h"
+#include "Profiler.h"
 
-class CHF16CombatStick : public Joystick {
+class CHF16CombatStick final : public Joystick {
 public:
-  const Description &getDescription() const override {
+  Description getDescription() const override {
     // CH F16 Combat Stick from 1995
-    static const Description description{"CH F16 Combat Stick", 3, 10, 1};
-    return description;
+    static const char name[] PROGMEM = "CH F16 Combat Stick";
+    static const Description description PROGMEM{name, 3, 10, 1};
+    return Flash::read(description);
   }
 
   const State &getState() const override {
@@ -32,7 +36,7 @@ public:
   }
 
   bool init() override {  
-    return true;
+    return m_joystick.init();
   }
 
 
@@ -40,35 +44,43 @@ public:
     const auto decodeHat = [](byte code) -> byte {
       // Same as CH Flight Stick Pro. But the F16 stick has 4 positions on the hat only.
       //                                 0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15
-      static constexpr byte table[16] = {0, 0, 0, 7, 0, 0, 0, 5, 0, 0, 0, 3, 0, 0, 0, 1};
-      return (code < sizeof(table)) ? table[code] : 0u;
+      static const byte table[16] PROGMEM = {0, 0, 0, 7, 0, 0, 0, 5, 0, 0, 0, 3, 0, 0, 0, 1};
+      return Flash::read(table, code);
     };
 
     const auto decodeButtons = [](byte code) -> uint16_t {
       // Map to 10 buttons: 5 real ones, one hat with 4 positions. Thus we need uint16 instead of byte
       //                                     0  1  2  3  4   5    6  7   8  9   10 11   12 13  14 15
-      static constexpr uint16_t table[16] = {0, 1, 8, 0, 4, 32, 256, 0, 16, 2, 128, 0, 512, 0, 64, 0};
-      static constexpr auto tableSize = sizeof(table) / sizeof(table[0]);
-      return (code < tableSize) ? table[code] : 0u;
+      static const uint16_t table[16] PROGMEM = {0, 1, 8, 0, 4, 32, 256, 0, 16, 2, 128, 0, 512, 0, 64, 0};
+      return Flash::read(table, code);
     };
 
     // The 4th axis (index 2) is ignored, because there is a big jitter
     // and it reacts on movement of the other axes too. So you can not
     // assign the axes to a function in your game.
-    m_state.axes[0] = m_joystick.getAxis(0);
-    m_state.axes[1] = m_joystick.getAxis(1);
-    m_state.axes[2] = m_joystick.getAxis(3); // Throttle
-    
-    const auto code = m_joystick.getButtons();
+    const auto code = Profiler::measure(Profiler::Stage::acquire, [this] {
+      m_joystick.sampleAxes(0b1011);
+      m_state.axes[0] = m_joystick.getAxis(0);
+      m_state.axes[1] = m_joystick.getAxis(1);
+      m_state.axes[2] = m_joystick.getAxis(3); // Throttle
+      return m_joystick.readButtons();
+    });
 
-    m_state.hat = decodeHat(code);
-    m_state.buttons = decodeButtons(code);
+    // Codes, which are neither a hat position nor a button, are
+    // intermediate states while the hat or a combination is changing.
+    Profiler::measure(Profiler::Stage::decode, [&] {
+      const auto valid = code == 0u || decodeHat(code) != 0u || decodeButtons(code) != 0u;
+      const auto filtered = m_filter.update(code, valid);
+      m_state.hat = decodeHat(filtered);
+      m_state.buttons = decodeButtons(filtered);
+    });
   
     log("Code %d : %d , A2 %d", code, m_state.buttons, m_state.axes[2] );
-    return true;
+    return m_joystick.isConnected();
   }
 
 private:
   AnalogJoystick m_joystick;
+  CodeFilter m_filter;
   State m_state;
 };
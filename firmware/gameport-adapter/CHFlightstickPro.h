@@ -17,13 +17,17 @@
 #pragma once
 
 #include "AnalogJoystick.h"
+#include "CodeFilter.h"
+#include "Flash.h"
 #include "Joystick.h"
+#include "Profiler.h"
 
-class CHFlightstickPro : public Joystick {
+class CHFlightstickPro final : public Joystick {
 public:
-  const Description &getDescription() const override {
-    static const Description description{"CH FlightStick Pro", 4, 4, 1};
-    return description;
+  Description getDescription() const override {
+    static const char name[] PROGMEM = "CH FlightStick Pro";
+    static const Description description PROGMEM{name, 4, 4, 1};
+    return Flash::read(description);
   }
 
   const State &getState() const override {
@@ -31,7 +35,7 @@ public:
   }
 
   bool init() override {
-    return true;
+    return m_joystick.init();
   }
 
   bool update() override {
@@ -46,23 +50,32 @@ public:
     // actually using the hat switch.
 
     const auto decode = [](byte code) -> byte {
-      static const byte table[16] = {0, 0, 0, 7, 0, 6, 0, 5, 0, 4, 0, 3, 0, 2, 0, 1};
-      return (code < sizeof(table)) ? table[code] : 0u;
+      static const byte table[16] PROGMEM = {0, 0, 0, 7, 0, 6, 0, 5, 0, 4, 0, 3, 0, 2, 0, 1};
+      return Flash::read(table, code);
     };
 
-    for (auto i = 0u; i < 4; i++) {
-      m_state.axes[i] = m_joystick.getAxis(i);
-    }
+    const auto code = Profiler::measure(Profiler::Stage::acquire, [this] {
+      m_joystick.sampleAxes(0b1111);
+      for (auto i = 0u; i < 4; i++) {
+        m_state.axes[i] = m_joystick.getAxis(i);
+      }
+      return m_joystick.readButtons();
+    });
 
-    const auto code = m_joystick.getButtons();
-    m_state.hat = decode(code);
-    m_state.buttons = m_state.hat ? 0u : code;
+    // Only single buttons and hat codes are possible, everything else is
+    // an intermediate state while the hat is moving.
+    const Profiler::Probe probe(Profiler::Stage::decode);
+    const auto valid = (code & (code - 1u)) == 0u || decode(code) != 0u;
+    const auto filtered = m_filter.update(code, valid);
+    m_state.hat = decode(filtered);
+    m_state.buttons = m_state.hat ? 0u : filtered;
 
-    return true;
+    return m_joystick.isConnected();
   }
 
 private:
   AnalogJoystick m_joystick;
+  CodeFilter m_filter;
   State m_state;
 };
 
@@ -0,0 +1,77 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+
+/// Transition filter for multiplexed button codes.
+///
+/// Some joysticks encode the hat and additional buttons as combinations
+/// of the button lines. When such a combination is pressed or released,
+/// the lines never change at exactly the same time, so the intermediate
+/// codes show up as spurious buttons or hat directions for a sample.
+///
+/// The filter accepts a release of everything immediately. Every other
+/// change has to be stable for some samples, before it is accepted. Even
+/// a single button out of the idle state is delayed, because every line
+/// is part of a hat code and shows up first, when the hat is pressed.
+/// Until then the last stable code is held, but only for a bounded number
+/// of samples.
+class CodeFilter {
+public:
+  /// Number of equal samples to accept a valid code.
+  static const uint8_t CONFIRM_SAMPLES{2};
+
+  /// Maximum number of samples to hold the last stable code.
+  static const uint8_t MAX_HOLD_SAMPLES{4};
+
+  /// Adds a new sample of the code.
+  /// @param[in] code is the raw code
+  /// @param[in] valid is true, if the code is a possible one
+  /// @returns the filtered code
+  uint8_t update(uint8_t code, bool valid) {
+    if (code == m_stable) {
+      m_held = 0u;
+      return m_stable;
+    }
+
+    // Releasing everything can't be an intermediate state, so don't delay it
+    if (code == 0u) {
+      return accept(code);
+    }
+
+    m_count = code == m_candidate ? m_count + 1u : 1u;
+    m_candidate = code;
+    if (++m_held >= MAX_HOLD_SAMPLES || (valid && m_count >= CONFIRM_SAMPLES)) {
+      return accept(code);
+    }
+    return m_stable;
+  }
+
+private:
+  uint8_t m_stable{};
+  uint8_t m_candidate{};
+  uint8_t m_count{};
+  uint8_t m_held{};
+
+  uint8_t accept(uint8_t code) {
+    m_stable = code;
+    m_held = 0u;
+    m_count = 0u;
+    return code;
+  }
+};
@@ -0,0 +1,216 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HidDevice.h"
+#include "Timer.h"
+#include "Utilities.h"
+#include <Arduino.h>
+#include <EEPROM.h>
+
+// Default USB polling interval in milliseconds, it can be overridden at
+// build time. Longer intervals reduce the USB load of slow devices.
+#ifndef USB_POLLING_INTERVAL
+#define USB_POLLING_INTERVAL 1
+#endif
+
+/// Runtime configuration.
+///
+/// The timing parameters of the protocols and a few other trade-offs
+/// between latency and noise can be tuned without reflashing. The values
+/// are read and written with the vendor defined HID feature report 0x14
+/// and are persisted in EEPROM. Drivers read the values, when they need
+/// them, so changes take effect with the next main loop cycle. Only the
+/// polling interval is advertised to the host during the enumeration, so
+/// it takes effect after the adapter was plugged in again.
+class Config {
+public:
+  static const uint8_t VERSION{2};
+
+  /// Flags of the configuration.
+  enum Flag : uint8_t {
+    /// Enables the log output of builds with logging.
+    LOG = 0x01,
+  };
+
+  /// Configuration block, all the values are little endian.
+  struct Data {
+    uint8_t version;
+    uint8_t flags;
+    /// USB polling interval in milliseconds.
+    uint8_t interval;
+    /// Initial half range of the analog axis calibration in ADC steps.
+    uint8_t analogWindow;
+    /// Analog axis filter, see AxisFilter::Parameters.
+    uint8_t axisAlpha;
+    uint8_t axisBeta;
+    uint8_t axisMaxLag;
+    /// Sidewinder minimal time between reads, start and strobe timeouts in us.
+    uint16_t sidewinderCooldown;
+    uint16_t sidewinderStart;
+    uint16_t sidewinderStrobe;
+    /// Logitech minimal time between reads, start and strobe timeouts in us.
+    uint16_t logitechCooldown;
+    uint16_t logitechStart;
+    uint16_t logitechStrobe;
+    /// Logitech power up time in milliseconds.
+    uint16_t logitechPowerUp;
+  };
+
+  /// Gets the current configuration.
+  ///
+  /// The configuration is loaded from EEPROM on first use. If there is no
+  /// valid block of the current version, the defaults are used.
+  static const Data &get() {
+    return getState().data;
+  }
+
+  /// Takes over and persists a received configuration.
+  ///
+  /// The drivers read the values with enabled interrupts, so a block
+  /// received in the USB interrupt is only taken over here in the main
+  /// loop, to never expose half written values. Writing the EEPROM takes
+  /// several milliseconds per byte, so it's done here as well.
+  static void poll() {
+    auto &state = getState();
+    if (!state.received) {
+      return;
+    }
+    {
+      const InterruptStopper noirq;
+      state.data = state.pending;
+      state.received = false;
+    }
+    const auto &data = state.data;
+    apply(data);
+    const auto bytes = reinterpret_cast<const uint8_t *>(&data);
+    EEPROM.update(ADDRESS, MAGIC);
+    for (auto i = 0u; i < sizeof(data); i++) {
+      EEPROM.update(ADDRESS + 1 + i, bytes[i]);
+    }
+    EEPROM.update(ADDRESS + 1 + sizeof(data), getChecksum(data));
+    log("Configuration saved");
+  }
+
+  /// HID feature report with the configuration block.
+  ///
+  /// Reading returns the current block. A written block of the current
+  /// version replaces the configuration, a block with version 0 restores
+  /// the defaults. Blocks with values out of range are rejected, i.e. an
+  /// interval above 32 ms, an analog window below 16 steps, timeouts of 0
+  /// or above Timer::MAX_MICROS and a power up time above 1 second.
+  class Report : public VendorFeature {
+  public:
+    static const uint8_t ID{0x14};
+
+    Report()
+    : VendorFeature(ID, sizeof(Data)) {
+    }
+
+    int send() override {
+      return USB_SendControl(0, &get(), sizeof(Data));
+    }
+
+    bool receive(uint16_t length) override {
+      uint8_t buffer[1 + sizeof(Data)];
+      if (length != sizeof(buffer) || USB_RecvControl(buffer, sizeof(buffer)) != sizeof(buffer)) {
+        return false;
+      }
+      Data data;
+      memcpy(&data, buffer + 1, sizeof(data));
+      if (data.version == 0u) {
+        data = getDefaults();
+      } else if (!isValid(data)) {
+        return false;
+      }
+      auto &state = getState();
+      state.pending = data;
+      state.received = true;
+      return true;
+    }
+  };
+
+private:
+  /// EEPROM layout, placed behind the detection cache of AutoDetect.
+  static const int ADDRESS{16};
+  static const uint8_t MAGIC{0xC5};
+
+  struct State {
+    Data data;
+    Data pending;
+    volatile bool received;
+  };
+
+  static State &getState() {
+    static State state{load(), {}, false};
+    return state;
+  }
+
+  static Data getDefaults() {
+    return Data{VERSION, LOG, USB_POLLING_INTERVAL, 100u, 0u, 2u, 16u, 3000u, 600u, 60u, 5000u, 200u, 40u, 100u};
+  }
+
+  /// Limits of the values.
+  static const uint8_t MAX_INTERVAL{32u};
+  static const uint8_t MIN_ANALOG_WINDOW{16u};
+  static const uint16_t MAX_POWER_UP{1000u};
+
+  static bool isTimeout(uint16_t us) {
+    return us > 0u && us <= Timer::MAX_MICROS;
+  }
+
+  static bool isValid(const Data &data) {
+    return data.version == VERSION && data.interval > 0u && data.interval <= MAX_INTERVAL &&
+           data.analogWindow >= MIN_ANALOG_WINDOW &&
+           (data.axisAlpha == 0u || data.axisBeta <= data.axisAlpha) &&
+           isTimeout(data.sidewinderStart) && isTimeout(data.sidewinderStrobe) &&
+           isTimeout(data.logitechStart) && isTimeout(data.logitechStrobe) &&
+           data.logitechPowerUp <= MAX_POWER_UP;
+  }
+
+  static uint8_t getChecksum(const Data &data) {
+    const auto bytes = reinterpret_cast<const uint8_t *>(&data);
+    uint8_t sum = MAGIC;
+    for (auto i = 0u; i < sizeof(data); i++) {
+      sum += bytes[i];
+    }
+    return sum;
+  }
+
+  static Data load() {
+    Data data;
+    const auto bytes = reinterpret_cast<uint8_t *>(&data);
+    for (auto i = 0u; i < sizeof(data); i++) {
+      bytes[i] = EEPROM.read(ADDRESS + 1 + i);
+    }
+    if (EEPROM.read(ADDRESS) != MAGIC || EEPROM.read(ADDRESS + 1 + sizeof(data)) != getChecksum(data) ||
+        !isValid(data)) {
+      data = getDefaults();
+    }
+    apply(data);
+    return data;
+  }
+
+  /// Applies the values, which are not read by the drivers.
+  static void apply(const Data &data) {
+#ifdef NDEBUG
+    (void)data;
+#else
+    isLogEnabled() = data.flags & LOG;
+#endif
+  }
+};
@@ -0,0 +1,76 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+
+/// Bit parallel button debouncer.
+///
+/// Every button has its own counter of consecutive samples, which differ
+/// from the debounced state. The counters are stored vertically, i.e. the
+/// first bits of all the counters are in one word, the second bits in the
+/// next word and so on. So all 16 buttons are debounced with a handful of
+/// bitwise operations, independent of the number of buttons.
+///
+/// A button is considered pressed after PressSamples and released after
+/// ReleaseSamples consecutive samples. Buttons bounce mostly on release,
+/// so the press can be accepted faster to keep the latency low.
+/// @tparam PressSamples is the number of samples to accept a press (1..7)
+/// @tparam ReleaseSamples is the number of samples to accept a release (1..7)
+template <uint8_t PressSamples = 2, uint8_t ReleaseSamples = 4>
+class Debouncer {
+  static_assert(PressSamples > 0 && PressSamples < 8, "Press samples out of range");
+  static_assert(ReleaseSamples > 0 && ReleaseSamples < 8, "Release samples out of range");
+
+public:
+  /// Adds a new sample of the buttons.
+  /// @param[in] buttons are the raw buttons, every bit is a button
+  /// @returns the debounced buttons
+  uint16_t update(uint16_t buttons) {
+    const uint16_t delta = buttons ^ m_state;
+
+    // Count the samples, which differ from the state, reset the others
+    m_count2 = (m_count2 ^ (m_count1 & m_count0)) & delta;
+    m_count1 = (m_count1 ^ m_count0) & delta;
+    m_count0 = ~m_count0 & delta;
+
+    const uint16_t toggle = (~m_state & equals(PressSamples)) | (m_state & equals(ReleaseSamples));
+    m_state ^= toggle;
+    m_count0 &= ~toggle;
+    m_count1 &= ~toggle;
+    m_count2 &= ~toggle;
+    return m_state;
+  }
+
+  /// Gets the debounced buttons.
+  uint16_t getState() const {
+    return m_state;
+  }
+
+private:
+  uint16_t m_state{};
+  uint16_t m_count0{};
+  uint16_t m_count1{};
+  uint16_t m_count2{};
+
+  /// Gets the buttons, which counters have the given value.
+  uint16_t equals(uint8_t value) const {
+    return (value & 1 ? m_count0 : uint16_t(~m_count0)) &
+           (value & 2 ? m_count1 : uint16_t(~m_count1)) &
+           (value & 4 ? m_count2 : uint16_t(~m_count2));
+  }
+};
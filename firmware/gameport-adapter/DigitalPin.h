@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "Timer.h"
 #include <Arduino.h>
 
 /// Digital signal edge types.
@@ -120,43 +121,159 @@ public:
 
   /// Waits for an edge with given timeout.
   /// @param[in] edge is the type of edge to wait for
-  /// @param[in] timeount is the timeout in microseconds
+  /// @param[in] timeout is the timeout in microseconds
+  /// @returns the remaining time in microseconds or 0 on timeout
   uint16_t wait(Edge edge, uint16_t timeout) const {
+    Timer::Ticks timestamp;
+    return capture(edge, timeout, timestamp);
+  }
+
+  /// Waits for an edge and captures its timestamp.
+  ///
+  /// The timestamp is taken from the free running Timer right before the
+  /// edge was sampled, so the difference of two captures is the period of
+  /// the signal with the accuracy of one polling loop iteration.
+  /// @param[in] edge is the type of edge to wait for
+  /// @param[in] timeout is the timeout in microseconds (max 32767)
+  /// @param[out] timestamp is the Timer timestamp of the edge
+  /// @returns the remaining time in microseconds or 0 on timeout
+  uint16_t capture(Edge edge, uint16_t timeout, Timer::Ticks &timestamp) const {
     if (edge == Edge::falling) {
-      return waitImpl(timeout, [](uint8_t a, uint8_t) {return a;});
+      return waitImpl(timeout, timestamp, [](uint8_t a, uint8_t) {return a;});
     }
     if (edge == Edge::rising) {
-      return waitImpl(timeout, [](uint8_t, uint8_t b) {return b;});
+      return waitImpl(timeout, timestamp, [](uint8_t, uint8_t b) {return b;});
     }
-    // edge == Edge::rising
-    return waitImpl(timeout, [](uint8_t a, uint8_t b) {return a|b;});
+    // edge == Edge::any
+    return waitImpl(timeout, timestamp, [](uint8_t a, uint8_t b) {return a|b;});
   }
 
   /// Waits for a state with given timeout.
   /// @param[in] state is the state to wait for
-  /// @param[in] timeount is the timeout in microseconds
+  /// @param[in] timeout is the timeout in microseconds (max 32767)
+  /// @returns the remaining time in microseconds or 0 on timeout
   uint16_t wait(bool state, uint16_t timeout) const {
-    for (; state != isHigh() && timeout; timeout--)
-      ;
-    return timeout;
+    const auto start = Timer::now();
+    const auto limit = Timer::fromMicros(timeout);
+    for (;;) {
+      const auto elapsed = Timer::since(start);
+      if (elapsed >= limit) {
+        return 0u;
+      }
+      if (state == isHigh()) {
+        return remaining(limit, elapsed);
+      }
+    }
   }
 
 private:
   DigitalPin<Id> m_pin;
   volatile typename DigitalPin<Id>::RegType &m_input;
 
+  /// Converts remaining ticks to microseconds, rounded up to never give 0.
+  static uint16_t remaining(Timer::Ticks limit, Timer::Ticks elapsed) {
+    return Timer::toMicros(limit - elapsed + Timer::TICKS_PER_US - 1);
+  }
+
   template <typename T>
-  uint16_t waitImpl(uint16_t timeout, T compare) const {
+  uint16_t waitImpl(uint16_t timeout, Timer::Ticks &timestamp, T compare) const {
+    const auto start = Timer::now();
+    const auto limit = Timer::fromMicros(timeout);
     auto last = read();
-    for (; timeout; timeout--) {
+    for (;;) {
+      const auto elapsed = Timer::since(start);
+      if (elapsed >= limit) {
+        return 0u;
+      }
       const auto next = read();
       if (last != next) {
         if (compare(last, next)) {
-          return timeout;
+          timestamp = start + elapsed;
+          return remaining(limit, elapsed);
         }
         last = next;
       }
     }
+  }
+};
+
+/// Compile time pin mapping of the ATmega32U4 (Arduino Leonardo/Pro Micro).
+///
+/// The Arduino functions digitalPinToPort() and digitalPinToBitMask() read
+/// the mapping from flash at runtime. PinGroup needs it at compile time, so
+/// it is repeated here. Every entry contains the port (B=0, C=1, D=2, E=3,
+/// F=4) in the upper nibble and the bit number in the lower one.
+constexpr uint8_t pinMapping[] = {
+  0x22, 0x23, 0x21, 0x20, 0x24, 0x16, 0x27, 0x36, // D0..D7
+  0x04, 0x05, 0x06, 0x07, 0x26, 0x17, 0x03, 0x01, // D8..D15
+  0x02, 0x00, 0x47, 0x46, 0x45, 0x44, 0x41, 0x40, // D16..D23 (A0..A5)
+  0x24, 0x27, 0x04, 0x05, 0x06, 0x26, 0x25,       // D24..D30 (A6..A11)
+};
+
+constexpr uint8_t pinPort(int id) {
+  return pinMapping[id] >> 4;
+}
+
+constexpr uint8_t pinBit(int id) {
+  return pinMapping[id] & 0x0f;
+}
+
+/// Group of digital inputs, which are sampled at once.
+///
+/// Reading multiple pins with DigitalInput costs one register load per pin
+/// and the pins are not sampled at the same time. This group figures out at
+/// compile time which input registers the pins are spread over, reads every
+/// register exactly once and remaps the bits, so that the bit N of the result
+/// is the state of the N-th pin. All the pins are configured as inputs with
+/// pullup resistors.
+template <int... Ids>
+class PinGroup {
+public:
+  static_assert(sizeof...(Ids) > 0 && sizeof...(Ids) <= 8, "PinGroup supports 1 to 8 pins");
+
+  /// Constructor.
+  PinGroup() {
+    const int ids[] = {Ids...};
+    for (const auto id : ids) {
+      pinMode(id, INPUT_PULLUP);
+    }
+  }
+
+  /// Reads all the pins.
+  /// @returns the raw pin states, bit N is the N-th pin
+  uint8_t read() const {
+    const uint8_t ports[] = {readPort<0>(), readPort<1>(), readPort<2>(), readPort<3>(), readPort<4>()};
+    return remap<0, Ids...>(ports);
+  }
+
+private:
+  template <int... Pins>
+  struct PortMask {
+    static constexpr uint8_t value = 0u;
+  };
+
+  template <int Pin, int... Pins>
+  struct PortMask<Pin, Pins...> {
+    static constexpr uint8_t value = (1u << pinPort(Pin)) | PortMask<Pins...>::value;
+  };
+
+  /// Reads the input register of the port, but only if it is used.
+  template <uint8_t Port>
+  static uint8_t readPort() {
+    if (!(PortMask<Ids...>::value & (1u << Port))) {
+      return 0u;
+    }
+    return Port == 0 ? PINB : Port == 1 ? PINC : Port == 2 ? PIND : Port == 3 ? PINE : PINF;
+  }
+
+  template <uint8_t Pos>
+  static uint8_t remap(const uint8_t *) {
     return 0u;
   }
+
+  template <uint8_t Pos, int Id, int... Rest>
+  static uint8_t remap(const uint8_t *ports) {
+    const auto bit = (ports[pinPort(Id)] & (1u << pinBit(Id))) ? (1u << Pos) : 0u;
+    return bit | remap<Pos + 1, Rest...>(ports);
+  }
 };
@@ -0,0 +1,128 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "AnalogJoystick.h"
+#include "Flash.h"
+#include "Joystick.h"
+#include "Profiler.h"
+
+/// Two standard joysticks on one game port.
+///
+/// The game port was designed for two joysticks with 2 axes and 2 buttons
+/// each, which are usually connected with a Y cable. The first joystick
+/// uses the axes X1/Y1 (pins 3/6) and the buttons on the pins 2/7, the
+/// second one X2/Y2 (pins 11/13) and the buttons on the pins 10/14. Both
+/// are reported as two HID devices, but only the joystick, which has
+/// changed, is reported. The buttons are read in every update, but the
+/// axes of only one joystick, in turns, so its X and Y always match.
+class DualJoystick final : public Joystick {
+public:
+  bool init() override {
+    m_first.reset();
+    m_second.reset();
+    m_joystick.init();
+    return isConnected();
+  }
+
+  bool update() override {
+    static_assert(AnalogJoystick::AXES_PER_UPDATE >= 2, "Both axes of a joystick have to be sampled together");
+    m_sampleSecond = !m_sampleSecond;
+    const auto buttons = Profiler::measure(Profiler::Stage::acquire, [this] {
+      m_joystick.sampleAxes(m_sampleSecond ? 0b1100 : 0b0011);
+      return m_joystick.getButtons();
+    });
+    m_first.update(m_joystick.getAxis(0), m_joystick.getAxis(1), buttons & 0x03);
+    m_second.update(m_joystick.getAxis(2), m_joystick.getAxis(3), buttons >> 2 & 0x03);
+    return isConnected();
+  }
+
+  const State &getState() const override {
+    return m_first.getState();
+  }
+
+  Description getDescription() const override {
+    return m_first.getDescription();
+  }
+
+  bool isChanged() const override {
+    return m_first.isChanged();
+  }
+
+  const Joystick *getChained() const override {
+    return &m_second;
+  }
+
+private:
+  /// One of the joysticks, updated by the DualJoystick.
+  class Stick : public Joystick {
+  public:
+    explicit Stick(uint8_t index)
+    : m_index(index) {
+    }
+
+    bool init() override {
+      return true;
+    }
+
+    bool update() override {
+      return true;
+    }
+
+    void reset() {
+      m_state = State{};
+      m_changed = true;
+    }
+
+    void update(uint16_t x, uint16_t y, uint16_t buttons) {
+      m_changed = x != m_state.axes[0] || y != m_state.axes[1] || buttons != m_state.buttons;
+      m_state.axes[0] = x;
+      m_state.axes[1] = y;
+      m_state.buttons = buttons;
+    }
+
+    const State &getState() const override {
+      return m_state;
+    }
+
+    Description getDescription() const override {
+      static const char name1[] PROGMEM = "Dual Joystick 1";
+      static const char name2[] PROGMEM = "Dual Joystick 2";
+      static const Description descriptions[] PROGMEM = {{name1, 2, 2, 0}, {name2, 2, 2, 0}};
+      return Flash::read(descriptions[m_index]);
+    }
+
+    bool isChanged() const override {
+      return m_changed;
+    }
+
+  private:
+    uint8_t m_index;
+    bool m_changed{true};
+    State m_state;
+  };
+
+  AnalogJoystick m_joystick;
+  Stick m_first{0};
+  Stick m_second{1};
+  bool m_sampleSecond{};
+
+  /// Checks, whether any of the joysticks is connected.
+  bool isConnected() const {
+    return m_joystick.isConnected() || m_joystick.isSecondConnected();
+  }
+};
@@ -0,0 +1,53 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+
+/// Access to constant data in the program memory.
+///
+/// AVR copies all initialized data to RAM at startup, even if it is const.
+/// Data marked with PROGMEM stays in flash instead, but can't be accessed
+/// directly. It has to be read with these helpers.
+struct Flash {
+  static uint8_t read(const uint8_t &value) {
+    return pgm_read_byte(&value);
+  }
+
+  static uint16_t read(const uint16_t &value) {
+    return pgm_read_word(&value);
+  }
+
+  template <typename T>
+  static T *read(T *const &value) {
+    return static_cast<T *>(pgm_read_ptr(&value));
+  }
+
+  template <typename T>
+  static T read(const T &value) {
+    T result;
+    memcpy_P(&result, &value, sizeof(T));
+    return result;
+  }
+
+  /// Reads a table entry with bounds check.
+  /// @returns the entry or a default value, if the index is out of range
+  template <typename T, size_t Size>
+  static T read(const T (&table)[Size], size_t index, T fallback = T{}) {
+    return index < Size ? read(table[index]) : fallback;
+  }
+};
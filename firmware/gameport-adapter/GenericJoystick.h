@@ -18,34 +18,39 @@
 
 #include "Joystick.h"
 #include "AnalogJoystick.h"
+#include "Flash.h"
+#include "Profiler.h"
 
 template <size_t Axes, size_t Buttons>
-class GenericJoystick : public Joystick {
+class GenericJoystick final : public Joystick {
 public:
 
     static_assert(Axes > 0 && Axes <= 4);
 
     bool init() override {
-        return true;
+        return m_joystick.init();
     }
 
     bool update() override {
+        const Profiler::Probe probe(Profiler::Stage::acquire);
+        m_joystick.sampleAxes((1u << Axes) - 1u);
         for (auto i = 0u; i < Axes; i++) {
             m_state.axes[i] = m_joystick.getAxis(i);
         }
         m_state.buttons = m_joystick.getButtons();
-        return true;
+        return m_joystick.isConnected();
     }
 
     const State& getState() const override {
         return m_state;
     }
 
-    const Description& getDescription() const override {
-        static const Description description {
-            "Generic Joystick", Axes, Buttons, 0
+    Description getDescription() const override {
+        static const char name[] PROGMEM = "Generic Joystick";
+        static const Description description PROGMEM {
+            name, Axes, Buttons, 0
         };
-        return description;
+        return Flash::read(description);
     }
 
 private:
@@ -16,21 +16,37 @@
 
 #pragma once
 
+#include "Debouncer.h"
 #include "DigitalPin.h"
+#include "Flash.h"
 #include "Joystick.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 /// Class to communicate with Gravis joysticks using GrIP.
 /// @remark This is a green field implementation, but it was heavily
 ///         inspired by Linux Gravis/Kensington GrIP driver
 ///         implementation. See
-class GrIP : public Joystick {
+class GrIP final : public Joystick {
   ///         https://github.com/torvalds/linux/blob/master/drivers/input/joystick/grip.c
 public:
   /// Resets the joystick and tries to detect the model.
   bool init() override {
-    while (!readPacket())
-      ;
-    return true;
+    return probe();
+  }
+
+  /// Checks if a GrIP device is connected.
+  ///
+  /// The GamePad Pro sends its packets all the time, so this is done
+  /// by just listening for a valid packet for a few times.
+  /// @returns true if a valid packet was received
+  bool probe() const {
+    for (auto i = 0u; i < 3; i++) {
+      if (readPacket()) {
+        return true;
+      }
+    }
+    return false;
   }
 
   /// Reads the joystick state.
@@ -39,26 +55,32 @@ public:
   ///         returned and the joystick reset is executed.
   bool update() override {
 
-    const auto packet = readPacket();
+    const auto packet = Profiler::measure(Profiler::Stage::acquire, [this] { return readPacket(); });
+    const uint8_t bytes[] = {uint8_t(packet), uint8_t(packet >> 8), uint8_t(packet >> 16)};
+    Trace::record(Trace::Source::grip, 0, bytes, sizeof(bytes), 8);
     if (packet == 0) {
+      Trace::error();
       return false;
     }
 
-    const auto getBit = [&](uint8_t pos) { return uint8_t(packet >> pos) & 1; };
+    const Profiler::Probe probe(Profiler::Stage::decode);
 
-    m_state.axes[0] = map(1 + getBit(15) - getBit(16), 0, 2, 0, 1023);
-    m_state.axes[1] = map(1 + getBit(13) - getBit(12), 0, 2, 0, 1023);
+    const auto getBit = [&](uint8_t pos) { return uint8_t(packet >> pos) & 1; };
 
-    m_state.buttons = getBit(8);
-    m_state.buttons |= getBit(3) << 1;
-    m_state.buttons |= getBit(7) << 2;
-    m_state.buttons |= getBit(6) << 3;
-    m_state.buttons |= getBit(10) << 4;
-    m_state.buttons |= getBit(11) << 5;
-    m_state.buttons |= getBit(5) << 6;
-    m_state.buttons |= getBit(2) << 7;
-    m_state.buttons |= getBit(0) << 8;
-    m_state.buttons |= getBit(1) << 9;
+    m_state.axes[0] = 1 + getBit(15) - getBit(16);
+    m_state.axes[1] = 1 + getBit(13) - getBit(12);
+
+    uint16_t buttons = getBit(8);
+    buttons |= getBit(3) << 1;
+    buttons |= getBit(7) << 2;
+    buttons |= getBit(6) << 3;
+    buttons |= getBit(10) << 4;
+    buttons |= getBit(11) << 5;
+    buttons |= getBit(5) << 6;
+    buttons |= getBit(2) << 7;
+    buttons |= getBit(0) << 8;
+    buttons |= getBit(1) << 9;
+    m_state.buttons = m_debouncer.update(buttons);
 
     return true;
   }
@@ -67,9 +89,10 @@ public:
     return m_state;
   }
 
-  const Description &getDescription() const override {
-    static Description desc{"Gravis GamePad Pro", 2, 10, 0};
-    return desc;
+  Description getDescription() const override {
+    static const char name[] PROGMEM = "Gravis GamePad Pro";
+    static const Description desc PROGMEM{name, 2, 10, 0, {2, 2}};
+    return Flash::read(desc);
   }
 
 private:
@@ -89,6 +112,7 @@ private:
   DigitalInput<GamePort<2>::pin, true> m_clock;
   DigitalInput<GamePort<7>::pin, true> m_data;
   State m_state;
+  Debouncer<> m_debouncer;
 
   /// Read bits packet from the joystick.
   uint32_t readPacket() const {
@@ -97,11 +121,15 @@ private:
     // time. Every package starts with a binary tag sequence 011111.
 
     static const auto length = 24u;
+
+    // Maximum clock period in microseconds, same as GRIP_STROBE_GPP
+    // in the Linux driver.
+    static const uint16_t strobe = 200u;
     uint32_t result = 0u;
 
     // read a package of 24 bits
     for (auto i = 0u; i < length; i++) {
-      if (!m_clock.wait(Edge::falling, 100)) {
+      if (!m_clock.wait(Edge::falling, strobe)) {
         return 0u;
       }
       result |= uint32_t(m_data.isHigh()) << i;
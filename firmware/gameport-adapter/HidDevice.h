@@ -15,8 +15,187 @@
 
 #pragma once
 
+#include "Utilities.h"
 #include <HID.h>
 
+/// Part of the HID report descriptor.
+///
+/// All parts are concatenated to the report descriptor in the order, in
+/// which they were appended. Parts, which depend on the device, are
+/// generated again, whenever the host asks for them, so they need no RAM.
+struct HidDescriptor {
+  HidDescriptor(const void *data, uint16_t length)
+  : data(data)
+  , length(length) {
+  }
+
+  /// Sends the part to the host.
+  ///
+  /// This is called from the USB interrupt.
+  /// @returns the number of sent bytes or -1 on error
+  virtual int describe() const {
+    return USB_SendControl(0, data, length);
+  }
+
+  const void *data;
+  uint16_t length;
+  HidDescriptor *next{};
+};
+
+/// Writer of generated descriptor parts.
+///
+/// The bytes are sent to the host in small chunks. Additionally the size
+/// and a CRC of all the bytes are calculated, so a generated descriptor
+/// can be compared with a previous one without keeping any of them.
+class HidDescriptorWriter {
+public:
+  /// Constructor.
+  /// @param[in] send tells, whether the bytes are sent to the host
+  explicit HidDescriptorWriter(bool send = false)
+  : m_send(send) {
+  }
+
+  /// Writes a value as little endian bytes.
+  template <typename T>
+  HidDescriptorWriter &push(const T &value) {
+    auto bits = uint32_t(value);
+    for (auto i = 0u; i < sizeof(T); i++, bits >>= 8) {
+      write(uint8_t(bits));
+    }
+    return *this;
+  }
+
+  /// Sends the rest of the bytes.
+  /// @returns the number of sent bytes or -1 on error
+  int flush() {
+    if (m_used && m_sent >= 0) {
+      const auto res = USB_SendControl(0, m_chunk, m_used);
+      m_sent = res < 0 ? -1 : m_sent + res;
+    }
+    m_used = 0u;
+    return m_sent;
+  }
+
+  uint16_t getSize() const {
+    return m_size;
+  }
+
+  uint16_t getChecksum() const {
+    return m_checksum;
+  }
+
+private:
+  static const uint8_t CHUNK_SIZE{16};
+
+  uint8_t m_chunk[CHUNK_SIZE];
+  uint8_t m_used{};
+  uint16_t m_size{};
+  uint16_t m_checksum{0xffffu};
+  int m_sent{};
+  bool m_send;
+
+  void write(uint8_t value) {
+    // CRC-16-CCITT
+    m_checksum ^= uint16_t(value) << 8;
+    for (auto i = 0u; i < 8u; i++) {
+      m_checksum = m_checksum & 0x8000u ? (m_checksum << 1) ^ 0x1021u : m_checksum << 1;
+    }
+
+    if (m_send) {
+      m_chunk[m_used++] = value;
+      if (m_used == CHUNK_SIZE) {
+        flush();
+      }
+    }
+    m_size++;
+  }
+};
+
+/// HID feature report.
+///
+/// Feature reports are transferred on demand of the host via the control
+/// endpoint, e.g. to read diagnostics or to write a configuration. Every
+/// feature brings its own part of the report descriptor, which is appended
+/// to the HID descriptor together with the feature.
+class HidFeature : public HidDescriptor {
+public:
+  HidFeature(uint8_t id, const void *descriptor, uint16_t length)
+  : HidDescriptor(descriptor, length)
+  , m_id(id) {
+  }
+
+  virtual ~HidFeature() = default;
+  HidFeature(const HidFeature &) = delete;
+  HidFeature(HidFeature &&) = delete;
+  HidFeature &operator=(const HidFeature &) = delete;
+  HidFeature &operator=(HidFeature &&) = delete;
+
+  /// Sends the report to the host.
+  ///
+  /// The report ID is already sent, so only the data has to be sent
+  /// here with USB_SendControl(). This is called from the USB interrupt.
+  /// @returns the number of sent bytes or -1 on error
+  virtual int send() {
+    return 0;
+  }
+
+  /// Receives the report from the host.
+  ///
+  /// The data has to be read with one single USB_RecvControl() call and
+  /// starts with the report ID. It's not possible to read more data, than
+  /// USB_EP_SIZE. This is called from the USB interrupt with the number
+  /// of bytes sent by the host.
+  /// @returns true if the report was accepted
+  virtual bool receive(uint16_t) {
+    return false;
+  }
+
+  /// Gets the report ID of the feature.
+  uint8_t getId() const {
+    return m_id;
+  }
+
+private:
+  friend class HidDevice;
+  uint8_t m_id;
+  HidFeature *m_next{};
+};
+
+/// Vendor defined feature report.
+///
+/// The report is a plain array of bytes, which has to be interpreted by
+/// a tool on the host. The report ID is used as vendor usage as well. The
+/// descriptor is generated, when the host asks for it.
+class VendorFeature : public HidFeature {
+public:
+  VendorFeature(uint8_t id, uint8_t size)
+  : HidFeature(id, nullptr, DESCRIPTOR_SIZE)
+  , m_size(size) {
+  }
+
+  int describe() const override {
+    const auto id = getId();
+    const uint8_t descriptor[DESCRIPTOR_SIZE] = {
+        0x06, 0x00, 0xff, // usage page (vendor defined)
+        0x09, id,         // usage
+        0xa1, 0x01,       // collection (application)
+        0x85, id,         // report id
+        0x15, 0x00,       // logical min (0)
+        0x26, 0xff, 0x00, // logical max (255)
+        0x75, 0x08,       // report size (8)
+        0x95, m_size,     // report count
+        0x09, id,         // usage
+        0xb1, 0x02,       // feature (data, variable, absolute)
+        0xc0,             // end collection
+    };
+    return USB_SendControl(0, descriptor, sizeof(descriptor));
+  }
+
+private:
+  static const uint8_t DESCRIPTOR_SIZE{23};
+  uint8_t m_size;
+};
+
 class HidDevice : public PluggableUSBModule {
 public:
 
@@ -25,7 +204,7 @@ public:
     PluggableUSB().plug(this);
   }
 
-  void AppendDescriptor(HIDSubDescriptor *node) {
+  void AppendDescriptor(HidDescriptor *node) {
 
     if (rootNode == nullptr) {
       rootNode = node;
@@ -39,6 +218,68 @@ public:
     descriptorSize += node->length;
   }
 
+  void AppendFeature(HidFeature *feature) {
+
+    if (rootFeature == nullptr) {
+      rootFeature = feature;
+    } else {
+      auto current = rootFeature;
+      while (current->m_next) {
+        current = current->m_next;
+      }
+      current->m_next = feature;
+    }
+    AppendDescriptor(feature);
+  }
+
+  /// Checks if the host has read an interface descriptor, which differs
+  /// from the current one.
+  ///
+  /// The device is probed while the host enumerates it. If the probing
+  /// took too long, the host has seen an incomplete report descriptor.
+  /// The descriptors are only appended, so comparing the size is enough.
+  bool isOutdated() const {
+    // The interface descriptor is read from the USB interrupt
+    const InterruptStopper noirq;
+    return described && (describedSize != descriptorSize || describedInterval != interval);
+  }
+
+  /// Sets the polling interval of the endpoint in milliseconds.
+  ///
+  /// The host reads the interval during the enumeration, so it has to be
+  /// set before, or the device has to be reenumerated.
+  void setInterval(uint8_t value) {
+    interval = value;
+  }
+
+  /// Gets the polling interval of the endpoint in milliseconds.
+  uint8_t getInterval() const {
+    return interval;
+  }
+
+  /// Checks, whether the host has polled the endpoint in vain.
+  ///
+  /// The USB controller answers the polls with a NAK, while there is no
+  /// report to send. The flag is cleared by this call.
+  bool wasPolled() const {
+    // The USB interrupt selects the endpoints as well
+    const InterruptStopper noirq;
+    UENUM = pluggedEndpoint;
+    const auto polled = (UEINTX & _BV(NAKINI)) != 0;
+    UEINTX = uint8_t(~_BV(NAKINI));
+    return polled;
+  }
+
+  /// Forces the host to enumerate the device again.
+  void reenumerate() {
+    UDCON |= _BV(DETACH);
+    // The host detects the disconnect after a few milliseconds
+    delay(10);
+    const InterruptStopper noirq;
+    described = false;
+    UDCON &= ~_BV(DETACH);
+  }
+
   int SendReport(uint8_t id, const void *data, int len) const {
 
     const auto ret = USB_Send(pluggedEndpoint, &id, 1);
@@ -58,10 +299,13 @@ protected:
 
   int getInterface(uint8_t *interfaceCount) override {
     *interfaceCount += 1; // uses 1
+    described = true;
+    describedSize = descriptorSize;
+    describedInterval = interval;
     HIDDescriptor hidInterface {
         D_INTERFACE(pluggedInterface, 1, USB_DEVICE_CLASS_HUMAN_INTERFACE, HID_SUBCLASS_NONE, HID_PROTOCOL_NONE),
         D_HIDREPORT(descriptorSize),
-        D_ENDPOINT(USB_ENDPOINT_IN(pluggedEndpoint), USB_ENDPOINT_TYPE_INTERRUPT, USB_EP_SIZE, 0x01)
+        D_ENDPOINT(USB_ENDPOINT_IN(pluggedEndpoint), USB_ENDPOINT_TYPE_INTERRUPT, USB_EP_SIZE, interval)
     };
     return USB_SendControl(0, &hidInterface, sizeof(hidInterface));
   }
@@ -83,7 +327,10 @@ protected:
 
     int total = 0;
     for (auto node = rootNode; node; node = node->next) {
-      const auto res = USB_SendControl(0, node->data, node->length);
+      if (!node->length) {
+        continue;
+      }
+      const auto res = node->describe();
       if (res < 0) {
         return -1;
       }
@@ -118,6 +365,9 @@ protected:
 
     if (requestType == REQUEST_DEVICETOHOST_CLASS_INTERFACE) {
       if (request == HID_GET_REPORT) {
+        if (setup.wValueH == HID_REPORT_TYPE_FEATURE) {
+          return sendFeature(setup.wValueL);
+        }
         // TODO: HID_GetReport();
         return true;
       }
@@ -142,13 +392,9 @@ protected:
         return true;
       }
       if (request == HID_SET_REPORT) {
-        // uint8_t reportID = setup.wValueL;
-        // uint16_t length = setup.wLength;
-        // uint8_t data[length];
-        // Make sure to not read more data than USB_EP_SIZE.
-        // You can read multiple times through a loop.
-        // The first byte (may!) contain the reportID on a multreport.
-        // USB_RecvControl(data, length);
+        if (setup.wValueH == HID_REPORT_TYPE_FEATURE) {
+          return receiveFeature(setup.wValueL, setup.wLength);
+        }
       }
     }
 
@@ -156,10 +402,37 @@ protected:
   }
 
 private:
+  HidFeature *findFeature(uint8_t id) const {
+    for (auto feature = rootFeature; feature; feature = feature->m_next) {
+      if (feature->m_id == id) {
+        return feature;
+      }
+    }
+    return nullptr;
+  }
+
+  bool sendFeature(uint8_t id) {
+    const auto feature = findFeature(id);
+    if (!feature) {
+      return false;
+    }
+    return USB_SendControl(0, &id, 1) >= 0 && feature->send() >= 0;
+  }
+
+  bool receiveFeature(uint8_t id, uint16_t length) {
+    const auto feature = findFeature(id);
+    return feature && feature->receive(length);
+  }
+
   uint8_t epType[1]{EP_TYPE_INTERRUPT_IN};
-  HIDSubDescriptor *rootNode{nullptr};
+  HidDescriptor *rootNode{nullptr};
+  HidFeature *rootFeature{nullptr};
   uint16_t descriptorSize{0};
   uint8_t protocol{HID_REPORT_PROTOCOL};
   uint8_t idle{1};
+  uint8_t interval{1};
+  volatile bool described{false};
+  uint16_t describedSize{0};
+  uint8_t describedInterval{0};
 };
 
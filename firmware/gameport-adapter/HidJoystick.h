@@ -17,42 +17,229 @@
 #pragma once
 
 #include "Buffer.h"
+#include "Config.h"
 #include "HidDevice.h"
 #include "Joystick.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include "UsbMonitor.h"
 #include "Utilities.h"
 #include <Arduino.h>
 
+/// HID joystick.
+///
+/// Exposes the Joystick as a USB HID device. The HID descriptor is created
+/// once from the initialized joystick and can't be changed without USB
+/// reenumeration. If the device stops answering, a neutral state is reported
+/// and the joystick is reinitialized with an increasing backoff. Reporting
+/// resumes as soon as a device with the same layout is plugged in again.
 class HidJoystick {
 public:
   bool init(Joystick *joystick) {
-    if (!joystick || !joystick->init()) {
+    if (!joystick) {
       return false;
     }
 
-    m_joystick = joystick;
-    m_hidDescription = createDescription(*m_joystick);
-    m_subDescriptor = new HIDSubDescriptor{m_hidDescription.data, m_hidDescription.size};
-    m_hidDevice.AppendDescriptor(m_subDescriptor);
+    // The descriptor of some devices depends on the detected model, so
+    // they have to be initialized once, before the USB device can be
+    // described. All the others are waited for in the update loop.
+    if (joystick->needsDetection()) {
+      while (!joystick->init())
+        ;
+    } else if (!joystick->init()) {
+      log("No device connected");
+      waitForDevice();
+    }
 
-    log("Detected device: %s", joystick->getDescription().name);
+    m_joystick = joystick;
+    setup(*joystick);
     return true;
   }
 
   bool update() {
-    if (!m_joystick || !m_joystick->update()) {
+    if (!m_joystick) {
+      return false;
+    }
+
+    if (!m_connected) {
+      if (isReconnectDue()) {
+        reconnect(*m_joystick, m_joystick->init());
+      }
+      return false;
+    }
+
+    if (USBDevice.configured()) {
+      Profiler::mark(Profiler::Milestone::configured);
+    }
+
+    const Profiler::Probe probe(Profiler::Stage::total);
+    UsbMonitor::cycle(m_hidDevice.getInterval(), m_hidDevice.wasPolled());
+
+    if (!m_joystick->update()) {
+      if (++m_failures >= MAX_FAILURES) {
+        disconnect(*m_joystick);
+      }
       return false;
     }
+    m_failures = 0u;
 
-    const auto packet = createPacket(*m_joystick);
-    m_hidDevice.SendReport(DEVICE_ID, packet.data, packet.size);
+    // Chained devices are read by the first joystick in the same cycle
+    // and are reported with the subsequent report IDs. Unchanged devices
+    // are reported again only, if their last report failed.
+    auto id = DEVICE_ID;
+    if (isDue(0u, m_joystick->isChanged()) && report(0u, send(id, m_joystick->getDescription(), m_joystick->getState()))) {
+      Profiler::mark(Profiler::Milestone::first_report);
+    }
+    auto index = 1u;
+    for (auto device = m_joystick->getChained(); device; device = device->getChained(), index++) {
+      if (isDue(index, device->isChanged())) {
+        report(index, send(id + index, device->getDescription(), device->getState()));
+      }
+    }
     return true;
   }
 
 private:
-  using BufferType = Buffer<255>;
   static const uint8_t DEVICE_ID{3};
 
-  static BufferType createDescription(const Joystick &joystick) {
+  /// Largest possible report with all the axes, the hat and the buttons.
+  static const uint8_t PACKET_SIZE{Joystick::MAX_AXES * sizeof(Joystick::State::axes[0]) + 1u + sizeof(Joystick::State::buttons)};
+  using PacketType = Buffer<PACKET_SIZE>;
+
+  /// HID descriptor of the joystick and its chained devices.
+  ///
+  /// The descriptor is generated from the device descriptions, whenever
+  /// the host asks for it, so it needs no buffer. Only its size and CRC are
+  /// kept to check a reinitialized device.
+  struct JoystickDescriptor : HidDescriptor {
+    JoystickDescriptor()
+    : HidDescriptor(nullptr, 0u) {
+    }
+
+    int describe() const override {
+      HidDescriptorWriter writer(true);
+      createDescriptions(*joystick, writer);
+      return writer.flush();
+    }
+
+    const Joystick *joystick{};
+  };
+
+  /// Number of failed updates in a row to consider the device unplugged.
+  static const uint8_t MAX_FAILURES{5};
+
+  /// Limits of the reinitialization backoff in milliseconds.
+  static const uint16_t MIN_BACKOFF{10u};
+  static const uint16_t MAX_BACKOFF{500u};
+
+  void setup(const Joystick &joystick) {
+    HidDescriptorWriter writer;
+    createDescriptions(joystick, writer);
+    m_descriptorSize = writer.getSize();
+    m_descriptorChecksum = writer.getChecksum();
+    m_descriptor.joystick = &joystick;
+    m_descriptor.length = m_descriptorSize;
+    m_defaultAxes = findDefaultAxes(joystick);
+    m_hidDevice.AppendDescriptor(&m_descriptor);
+    m_hidDevice.AppendFeature(&m_profilerReport);
+    m_hidDevice.AppendFeature(&m_traceControlReport);
+    m_hidDevice.AppendFeature(&m_traceDataReport);
+    m_hidDevice.AppendFeature(&m_memoryReport);
+    m_hidDevice.AppendFeature(&m_configReport);
+    m_hidDevice.AppendFeature(&m_usbReport);
+    m_hidDevice.setInterval(Config::get().interval);
+
+    // The device is probed while the host is already enumerating it. If the
+    // host was faster, it has seen an incomplete descriptor and has to read
+    // it again.
+    if (m_hidDevice.isOutdated()) {
+      log("Descriptor was read too early, reenumerating");
+      m_hidDevice.reenumerate();
+    }
+    Profiler::mark(Profiler::Milestone::probed);
+
+    log("Detected device: %S", joystick.getDescription().name);
+  }
+
+  bool send(uint8_t id, const Joystick::Description &description, const Joystick::State &state) {
+    const auto defaultAxes = hasDefaultAxes(id);
+    const auto packet = Profiler::measure(Profiler::Stage::pack, [&description, &state, defaultAxes] {
+      return createPacket(description, state, defaultAxes);
+    });
+    const auto sent = Profiler::measure(Profiler::Stage::send, [this, id, &packet] {
+      return m_hidDevice.SendReport(id, packet.data, packet.size) >= 0;
+    });
+    UsbMonitor::report(sent);
+    return sent;
+  }
+
+  /// Reports neutral state for all the devices.
+  ///
+  /// Otherwise the host would keep the last reported state and pressed
+  /// buttons would stay pressed until the device is plugged in again.
+  void disconnect(const Joystick &joystick) {
+    log("Device disconnected");
+    waitForDevice();
+
+    auto id = DEVICE_ID;
+    for (const Joystick *device = &joystick; device; device = device->getChained()) {
+      const auto description = device->getDescription();
+      Joystick::State neutral;
+      for (auto i = 0u; i < description.numAxes; i++) {
+        neutral.axes[i] = (description.getAxisMax(i) + 1u) / 2u;
+      }
+      const auto packet = createPacket(description, neutral, hasDefaultAxes(id));
+      m_hidDevice.SendReport(id++, packet.data, packet.size);
+    }
+  }
+
+  /// Starts the reinitialization attempts with an increasing backoff.
+  void waitForDevice() {
+    m_connected = false;
+    m_backoff = MIN_BACKOFF;
+    m_lastAttempt = millis();
+    UsbMonitor::pause();
+  }
+
+  /// Checks, whether the next reinitialization attempt is due.
+  bool isReconnectDue() {
+    const auto now = millis();
+    if (now - m_lastAttempt < m_backoff) {
+      return false;
+    }
+    m_lastAttempt = now;
+    return true;
+  }
+
+  /// Accepts the reinitialized device or increases the backoff.
+  ///
+  /// The device is accepted only, if it results in the very same HID
+  /// descriptor, which was already sent to the host.
+  void reconnect(const Joystick &joystick, bool initialized) {
+    if (initialized && isCompatible(joystick)) {
+      log("Device reconnected");
+      m_connected = true;
+      m_failures = 0u;
+      return;
+    }
+    m_backoff = min(m_backoff * 2u, MAX_BACKOFF);
+  }
+
+  bool isCompatible(const Joystick &joystick) const {
+    HidDescriptorWriter writer;
+    createDescriptions(joystick, writer);
+    return writer.getSize() == m_descriptorSize && writer.getChecksum() == m_descriptorChecksum;
+  }
+
+  static void createDescriptions(const Joystick &joystick, HidDescriptorWriter &writer) {
+    auto id = DEVICE_ID;
+    for (const Joystick *device = &joystick; device; device = device->getChained()) {
+      createDescription(*device, id++, writer);
+    }
+  }
+
+  static void createDescription(const Joystick &joystick, uint8_t id, HidDescriptorWriter &writer) {
 
     enum class ID : uint8_t {
       application = 0x01,
@@ -66,6 +253,7 @@ private:
       input_data = 0x02,
       joystick = 0x04,
       logical_max = 0x26,
+      logical_max_32 = 0x27,
       logical_min = 0x15,
       report_count = 0x95,
       report_id = 0x85,
@@ -78,88 +266,172 @@ private:
       usage_page = 0x05,
     };
 
-    const auto &desc = joystick.getDescription();
-    BufferType buffer;
-    auto filler = BufferFiller(buffer);
+    const auto desc = joystick.getDescription();
+
+    auto pushFields = [&writer](uint8_t size, uint8_t count) {
+      writer.push(ID::report_size).push(size);
+      writer.push(ID::report_count).push(count);
+      writer.push(ID::input).push(ID::input_data);
+    };
 
-    auto pushData = [&filler](uint8_t size, uint8_t count) {
-      filler.push(ID::report_size).push(size);
-      filler.push(ID::report_count).push(count);
-      filler.push(ID::input).push(ID::input_data);
-      const auto padding = (size * count) % 8u;
+    auto pushPadding = [&writer](uint16_t bits) {
+      const auto padding = bits % 8u;
       if (padding) {
-        filler.push(ID::report_size).push<uint8_t>(8u - padding);
-        filler.push(ID::report_count).push<uint8_t>(1);
-        filler.push(ID::input).push(ID::input_const);
+        writer.push(ID::report_size).push<uint8_t>(8u - padding);
+        writer.push(ID::report_count).push<uint8_t>(1);
+        writer.push(ID::input).push(ID::input_const);
       }
     };
 
-    filler.push(ID::usage_page).push(ID::generic_desktop);
-    filler.push(ID::usage).push(ID::joystick);
-    filler.push(ID::collection).push(ID::application);
-    filler.push(ID::report_id).push<uint8_t>(DEVICE_ID);
+    writer.push(ID::usage_page).push(ID::generic_desktop);
+    writer.push(ID::usage).push(ID::joystick);
+    writer.push(ID::collection).push(ID::application);
+    writer.push(ID::report_id).push(id);
 
-    // Push axes
+    // The fields are packed without gaps, only the end of the report is
+    // padded to a full byte. So the hat shares its byte with the buttons.
+    uint16_t bits = 0u;
+
+    // Push axes, consecutive axes with the same range share one field
     if (desc.numAxes > 0) {
-      filler.push(ID::usage_page).push(ID::generic_desktop);
-      for (auto i = 0u; i < desc.numAxes; i++) {
-        static constexpr uint8_t x_axis = 0x30;
-        filler.push(ID::usage).push<uint8_t>(x_axis + i);
+      writer.push(ID::usage_page).push(ID::generic_desktop);
+      for (auto first = 0u; first < desc.numAxes;) {
+        const auto max = desc.getAxisMax(first);
+        auto count = 1u;
+        while (first + count < desc.numAxes && desc.getAxisMax(first + count) == max) {
+          count++;
+        }
+        for (auto i = first; i < first + count; i++) {
+          static constexpr uint8_t x_axis = 0x30;
+          writer.push(ID::usage).push<uint8_t>(x_axis + i);
+        }
+        writer.push(ID::logical_min).push<uint8_t>(0);
+        // Logical values are signed, larger ones need 4 bytes
+        if (max > 0x7fffu) {
+          writer.push(ID::logical_max_32).push<uint32_t>(max);
+        } else {
+          writer.push(ID::logical_max).push<uint16_t>(max);
+        }
+        const auto size = desc.getAxisBits(first);
+        pushFields(size, count);
+        bits += size * count;
+        first += count;
       }
-      filler.push(ID::logical_min).push<uint8_t>(0);
-      filler.push(ID::logical_max).push<uint16_t>(1023);
-      pushData(10, desc.numAxes);
     }
 
     // Push hat
     if (desc.hasHat) {
-      filler.push(ID::usage).push(ID::hat_switch);
-      filler.push(ID::logical_min).push<uint8_t>(1);
-      filler.push(ID::logical_max).push<uint16_t>(8);
-      pushData(4, 1);
+      writer.push(ID::usage).push(ID::hat_switch);
+      writer.push(ID::logical_min).push<uint8_t>(1);
+      writer.push(ID::logical_max).push<uint16_t>(8);
+      pushFields(4, 1);
+      bits += 4u;
     }
 
     // Push buttons
     if (desc.numButtons > 0) {
-      filler.push(ID::usage_page).push(ID::button);
-      filler.push(ID::usage_min).push<uint8_t>(1);
-      filler.push(ID::usage_max).push<uint8_t>(desc.numButtons);
-      filler.push(ID::logical_min).push<uint8_t>(0);
-      filler.push(ID::logical_max).push<uint16_t>(1);
-      pushData(1, desc.numButtons);
+      writer.push(ID::usage_page).push(ID::button);
+      writer.push(ID::usage_min).push<uint8_t>(1);
+      writer.push(ID::usage_max).push<uint8_t>(desc.numButtons);
+      writer.push(ID::logical_min).push<uint8_t>(0);
+      writer.push(ID::logical_max).push<uint16_t>(1);
+      pushFields(1, desc.numButtons);
+      bits += desc.numButtons;
     }
 
-    filler.push(ID::end_collection);
-    return buffer;
+    pushPadding(bits);
+    writer.push(ID::end_collection);
   }
 
-  static BufferType createPacket(const Joystick &joystick) {
+  /// Finds the devices, whose axes all have the default range.
+  ///
+  /// The ranges never change for a connected device, so the check is
+  /// done only once instead of on every report.
+  /// @returns a bit for every device in the chain
+  static uint8_t findDefaultAxes(const Joystick &joystick) {
+    uint8_t result = 0u;
+    auto index = 0u;
+    for (const Joystick *device = &joystick; device; device = device->getChained(), index++) {
+      if (device->getDescription().hasDefaultAxes()) {
+        result |= _BV(index);
+      }
+    }
+    return result;
+  }
 
-    const auto &state = joystick.getState();
-    const auto &description = joystick.getDescription();
-    BufferType buffer;
-    auto filler = BufferFiller(buffer);
+  /// Checks, whether the axes of the device with the given report ID all
+  /// have the default range.
+  bool hasDefaultAxes(uint8_t id) const {
+    return m_defaultAxes & _BV(id - DEVICE_ID);
+  }
+
+  static PacketType createPacket(const Joystick::Description &description, const Joystick::State &state, bool defaultAxes) {
 
-    for (auto i = 0u; i < description.numAxes; i++) {
-      filler.push(state.axes[i], 10);
+    PacketType buffer;
+
+    // Most devices have 10 bit axes only, 4 of them fill exactly 5 bytes
+    auto axis = 0u;
+    if (defaultAxes) {
+      for (; axis + 4u <= description.numAxes; axis += 4u) {
+        pack10(state.axes + axis, buffer.data + buffer.size);
+        buffer.size += 5u;
+      }
     }
-    filler.align();
 
+    auto filler = BufferFiller(buffer);
+    for (; axis < description.numAxes; axis++) {
+      filler.push(state.axes[axis], description.getAxisBits(axis));
+    }
     if (description.hasHat) {
       filler.push(state.hat, 4);
-      filler.align();
     }
-
     if (description.numButtons) {
       filler.push(state.buttons, description.numButtons);
-      filler.align();
     }
+    filler.align();
 
     return buffer;
   }
 
-  Joystick *m_joystick{};
-  BufferType m_hidDescription{};
-  HIDSubDescriptor *m_subDescriptor{};
+  /// Packs 4 axes with 10 bits into 5 bytes without any branches.
+  static void pack10(const uint16_t *axes, uint8_t *data) {
+    data[0] = axes[0];
+    data[1] = (axes[0] >> 8 & 0x03) | axes[1] << 2;
+    data[2] = (axes[1] >> 6 & 0x0f) | axes[2] << 4;
+    data[3] = (axes[2] >> 4 & 0x3f) | axes[3] << 6;
+    data[4] = axes[3] >> 2;
+  }
+
+  /// Checks, whether the device with the given index has to be reported.
+  bool isDue(uint8_t index, bool changed) const {
+    return changed || (m_unsent & _BV(index));
+  }
+
+  /// Remembers the devices, whose last report failed.
+  bool report(uint8_t index, bool sent) {
+    if (sent) {
+      m_unsent &= ~_BV(index);
+    } else {
+      m_unsent |= _BV(index);
+    }
+    return sent;
+  }
+
+  bool m_connected{true};
+  uint8_t m_failures{};
+  uint8_t m_unsent{};
+  uint8_t m_defaultAxes{};
+  uint16_t m_backoff{MIN_BACKOFF};
+  unsigned long m_lastAttempt{};
+  uint16_t m_descriptorSize{};
+  uint16_t m_descriptorChecksum{};
+  JoystickDescriptor m_descriptor;
   HidDevice m_hidDevice;
+  Profiler::Report m_profilerReport;
+  Trace::ControlReport m_traceControlReport;
+  Trace::DataReport m_traceDataReport;
+  Memory::Report m_memoryReport;
+  Config::Report m_configReport;
+  UsbMonitor::Report m_usbReport{m_hidDevice};
+  Joystick *m_joystick{};
 };
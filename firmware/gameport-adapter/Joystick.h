@@ -23,13 +23,17 @@ class Joystick {
 public:
   static const auto MAX_AXES{16u};
 
+  /// Default logical maximum of an axis, e.g. of the analog axes.
+  static const uint16_t DEFAULT_AXIS_MAX{1023u};
+
   /// Device description.
   ///
   /// This structure is used to generate the HID description
-  /// and USB data packages
+  /// and USB data packages. Fixed descriptions are kept in the
+  /// program memory and have to be read with Flash::read().
   struct Description {
 
-    /// Human readable name.
+    /// Human readable name in the program memory.
     const char* name;
 
     /// Number of supported axes.
@@ -40,6 +44,36 @@ public:
 
     /// Has HAT.
     bool hasHat;
+
+    /// Logical maximum of every axis.
+    ///
+    /// Axes are reported with their native resolution, the bit width of
+    /// an axis is derived from its maximum. Zero stands for the default
+    /// maximum, so descriptions of 10 bit axes can leave it out.
+    uint16_t axisMax[MAX_AXES];
+
+    uint16_t getAxisMax(uint8_t axis) const {
+      return axisMax[axis] ? axisMax[axis] : DEFAULT_AXIS_MAX;
+    }
+
+    /// Checks, whether all the axes have the default range.
+    bool hasDefaultAxes() const {
+      for (auto i = 0u; i < numAxes; i++) {
+        if (getAxisMax(i) != DEFAULT_AXIS_MAX) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /// Gets the number of bits needed for the values of the axis.
+    uint8_t getAxisBits(uint8_t axis) const {
+      uint8_t bits = 0u;
+      for (auto max = getAxisMax(axis); max; max >>= 1) {
+        bits++;
+      }
+      return bits;
+    }
   };
 
   /// Joystick state.
@@ -47,10 +81,9 @@ public:
 
     /// Axes.
     ///
-    /// To keep it simple all axes are unified to 10 bits
-    /// resolution. Every joystick has to map it's values
-    /// to the values 0..1023 independent from the internal
-    /// resolution of the device.
+    /// Every axis keeps the native resolution of the device, up to
+    /// 16 bits. The values range from 0 to the maximum given in the
+    /// Description.
     uint16_t axes[MAX_AXES]{};
 
     /// Hats.
@@ -68,22 +101,52 @@ public:
 
   /// Initialize joystick.
   ///
+  /// This function is called again, if the device was unplugged, so it
+  /// must not block, but give up, if no device answers.
+  ///
   /// @returns True on successful initialization
   virtual bool init() = 0;
 
+  /// Checks, whether the description depends on the detected device.
+  ///
+  /// Such devices have to be initialized, before the HID descriptor can be
+  /// created. All the others are described right away and are treated as
+  /// unplugged, until they are initialized successfully.
+  virtual bool needsDetection() const {
+    return false;
+  }
+
   /// Update state.
   ///
   /// This function is called every time the joystick
   /// state has to be updated.
   ///
-  /// @returns True on successful initialization
+  /// @returns True if the device answered with a valid state
   virtual bool update() = 0;
 
   /// Gets the State of the Joystick.
   virtual const State &getState() const = 0;
 
   /// Gets the Description of the Joystick.
-  virtual const Description &getDescription() const = 0;
+  virtual Description getDescription() const = 0;
+
+  /// Gets the next chained Joystick.
+  ///
+  /// Some protocols allow multiple devices on the same game port. Such
+  /// devices are read together with the first one in the same update
+  /// cycle and every one of them is reported with its own HID report ID.
+  ///
+  /// @returns the next Joystick in the chain or nullptr
+  virtual const Joystick *getChained() const {
+    return nullptr;
+  }
+
+  /// Checks, whether the state has changed in the last update.
+  ///
+  /// Devices may skip the report, if nothing has changed.
+  virtual bool isChanged() const {
+    return true;
+  }
 
   Joystick() = default;
   virtual ~Joystick() = default;
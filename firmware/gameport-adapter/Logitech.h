@@ -16,213 +16,446 @@
 
 #pragma once
 
+#include "AxisLimits.h"
+#include "Buffer.h"
+#include "Config.h"
+#include "Debouncer.h"
 #include "DigitalPin.h"
+#include "Flash.h"
 #include "GamePort.h"
 #include "Joystick.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "Timer.h"
+#include "Trace.h"
 #include "Utilities.h"
 
-class Logitech : public Joystick {
+/// Class to communicate with Logitech joysticks using ADI.
+///
+/// The ADI protocol allows to chain two devices on one game port. The
+/// first device uses buttons 1 and 2 as data lines, the second one the
+/// buttons 3 and 4. Both devices answer to the same trigger, so they are
+/// read in the same cycle and the second device is exposed as chained
+/// joystick.
+/// @remark This implementation was inspired by the Linux ADI driver. See
+///         https://github.com/torvalds/linux/blob/master/drivers/input/joystick/adi.c
+class Logitech final : public Joystick {
 public:
+  bool needsDetection() const override {
+    return true;
+  }
+
   bool init() override {
     enableDigitalMode();
-    if (!readMetaData()) {
-      return false;
-    }
 
-    // Create joystick description
-    m_description.name = m_metaData.deviceName;
-    m_description.numAxes = min(Joystick::MAX_AXES,
-                                m_metaData.num10bitAxes + 
-                                m_metaData.num8bitAxes +
-                                m_metaData.numSecondaryHats * 2); // Each hat is mapped to two axes
-    m_description.numButtons = m_metaData.numPrimaryButtons + m_metaData.numSecondaryButtons;
-    m_description.hasHat = m_metaData.hasHat;
-
-    // If the device is a Logitech ThunderPad Digital, manually redefine the gamepad layout to 2 axes and 8 buttons
-    if(m_metaData.deviceID == DEVICE_THUNDERPAD_DIGITAL){
-      m_description.numAxes = 2;
-      m_description.numButtons = 8;
-      m_description.hasHat = 0;
+    const Memory::Scratch<Packets> packets;
+    readPackets(*packets);
+    m_lastRead = micros();
+    for (auto i = 0u; i < MAX_DEVICES; i++) {
+      const auto &packet = packets->device[i];
+      Trace::record(Trace::Source::adi_metadata, i, packet.data, packet.size, 1);
     }
-    // If the device is a Logitech WingMan Gamepad, manually redefine the gamepad layout to 2 axes and 11 buttons
-    else if(m_metaData.deviceID == DEVICE_WINGMAN_GAMEPAD){
-      m_description.numAxes = 2;
-      m_description.numButtons = 11;
-      m_description.hasHat = 0;
+    if (!m_devices[0].init(packets->device[0])) {
+      return false;
     }
+    m_chained = m_devices[1].init(packets->device[1]);
+    log("Chained device %s", m_chained ? "detected" : "not found");
+    return true;
+  }
+
+  /// Checks if an ADI device is connected.
+  ///
+  /// The initialization gives up on the first invalid metadata packet,
+  /// so it is used for probing as is.
+  bool probe() {
+    return init();
+  }
 
-    // Initialize axes centers
-    uint8_t axis = 0u;
-    for (auto i = 0u; i < m_metaData.num10bitAxes; i++, axis++) {
-      m_limits[axis] = { 512 - 256, 512 + 256 };
+  bool update() override {
+    cooldown();
+
+    const Memory::Scratch<Packets> packets;
+    Profiler::measure(Profiler::Stage::acquire, [&] { readPackets(*packets); });
+    m_lastRead = micros();
+    const auto devices = m_chained ? MAX_DEVICES : 1u;
+    for (auto i = 0u; i < devices; i++) {
+      const auto &packet = packets->device[i];
+      Trace::record(Trace::Source::adi_status, i, packet.data, packet.size, 1);
     }
-    for (auto i = 0u; i < m_metaData.num8bitAxes; i++, axis++) {
-      m_limits[axis] = { 128 - 64, 128 + 64 };
+
+    // The chained device is optional, so a broken packet of it should
+    // not invalidate the state of the first device.
+    const auto result = Profiler::measure(Profiler::Stage::decode, [&] {
+      if (m_chained) {
+        m_devices[1].update(packets->device[1]);
+      }
+      return m_devices[0].update(packets->device[0]);
+    });
+    if (!result) {
+      Trace::error();
     }
+    return result;
+  }
 
-    return true;
+  const State &getState() const override {
+    return m_devices[0].getState();
   }
 
-  bool update() override {
+  Description getDescription() const override {
+    return m_devices[0].getDescription();
+  }
 
-    // === Status packet format ===
-    //
-    // Offset Bits  Description
-    // --------------------------------------------------------
-    // 0      4     Low nibble of the Device ID
-    // 4      4     High nibble of the Device ID
-    // 8      10*N  10bit axes (N is number of axes)
-    // ?      8*N   8bit axes (N is number of axes)
-    // ?      1*N   Buttons (N is number of buttons)
-    // ?      R*N   Hats (R is resolution, N is number of hats)
-    // ?      1*N   Secondary buttons (N is number of buttons)
-
-    // Cyberman 2 seems not to work properly if the packets are
-    // read too fast. Following delay will ensure, that after the
-    // last read at least 5ms passed to ensure, that the joystick
-    // cooled down again.
-    delayMicroseconds(5000);
-
-    const auto packet = readPacket();
-
-    if (packet.size != m_metaData.packageSize) {
-      return false;
-    }
+  const Joystick *getChained() const override {
+    return m_chained ? &m_devices[1] : nullptr;
+  }
 
-    const auto packetID = getBits(packet, 0, 4) | getBits(packet, 4, 4) << 4;
-    if (packetID != m_metaData.deviceID) {
-      return false;
-    }
+private:
+  /// Replays recorded packets on the host, see firmware/tests.
+  friend class TraceReplay;
 
-    State state;
-    uint16_t offset = 8u;
+  static const auto MAX_DEVICES{2u};
 
-    uint8_t axis = 0u;
-    for (auto i = 0u; i < m_metaData.num10bitAxes; i++, axis++) {
-      state.axes[axis] = mapAxisValue(axis, getBits(packet, offset, 10));
-      offset += 10;
+  /// Internal bit structure which is filled by reading from the joystick.
+  using Packet = Buffer<255>;
+
+  /// Packets of all the devices, which are read in the same cycle.
+  struct Packets {
+    Packet device[MAX_DEVICES];
+  };
+
+  /// Single ADI device on the game port.
+  ///
+  /// The device doesn't communicate with the hardware by itself. It is
+  /// initialized and updated with the packets read by the Logitech class.
+  class Device : public Joystick {
+  public:
+    bool init() override {
+      return true;
     }
 
-    for (auto i = 0u; i < m_metaData.num8bitAxes; i++, axis++) {
-      state.axes[axis] = mapAxisValue(axis, getBits(packet, offset, 8));
-      offset += 8;
+    bool update() override {
+      return true;
     }
 
-    uint16_t button = 0u;
-    for (auto i = 0u; i < m_metaData.numPrimaryButtons; i++) {
-      state.buttons |= getBits(packet, offset++, 1) << button++;
+    /// Initializes the device from the metadata packet.
+    bool init(const Packet &packet) {
+      if (!readMetaData(packet)) {
+        return false;
+      }
+
+      // Create joystick description
+      m_description.name = getDeviceName(m_metaData.deviceID);
+      m_description.numAxes = min(Joystick::MAX_AXES,
+                                  unsigned(m_metaData.num10bitAxes + 
+                                           m_metaData.num8bitAxes +
+                                           m_metaData.numSecondaryHats * 2)); // Each hat is mapped to two axes
+      m_description.numButtons = m_metaData.numPrimaryButtons + m_metaData.numSecondaryButtons;
+      m_description.hasHat = m_metaData.hasHat;
+
+      // Initialize axes centers and ranges, secondary hats have 3 positions per axis
+      uint8_t axis = 0u;
+      for (auto i = 0u; i < m_metaData.num10bitAxes; i++, axis++) {
+        resetLimits(axis, 10);
+        m_description.axisMax[axis] = 1023u;
+      }
+      for (auto i = 0u; i < m_metaData.num8bitAxes; i++, axis++) {
+        resetLimits(axis, 8);
+        m_description.axisMax[axis] = 255u;
+      }
+      for (; axis < m_description.numAxes; axis++) {
+        m_description.axisMax[axis] = 2u;
+      }
+
+      // If the device is a Logitech ThunderPad Digital, manually redefine the gamepad layout to 2 axes and 8 buttons
+      if(m_metaData.deviceID == DEVICE_THUNDERPAD_DIGITAL){
+        m_description.numAxes = 2;
+        m_description.numButtons = 8;
+        m_description.hasHat = 0;
+        m_description.axisMax[0] = m_description.axisMax[1] = 2u;
+      }
+      // If the device is a Logitech WingMan Gamepad, manually redefine the gamepad layout to 2 axes and 11 buttons
+      else if(m_metaData.deviceID == DEVICE_WINGMAN_GAMEPAD){
+        m_description.numAxes = 2;
+        m_description.numButtons = 11;
+        m_description.hasHat = 0;
+        m_description.axisMax[0] = m_description.axisMax[1] = 2u;
+      }
+
+      for (axis = 0u; axis < m_metaData.num10bitAxes + m_metaData.num8bitAxes && axis < MAX_ANALOG_AXES; axis++) {
+        updateScale(axis);
+      }
+      return true;
     }
 
-    if (m_metaData.hasHat) {
+    /// Updates the state from the status packet.
+    bool update(const Packet &packet) {
+
+      // === Status packet format ===
+      //
+      // Offset Bits  Description
+      // --------------------------------------------------------
+      // 0      4     Low nibble of the Device ID
+      // 4      4     High nibble of the Device ID
+      // 8      10*N  10bit axes (N is number of axes)
+      // ?      8*N   8bit axes (N is number of axes)
+      // ?      1*N   Buttons (N is number of buttons)
+      // ?      R*N   Hats (R is resolution, N is number of hats)
+      // ?      1*N   Secondary buttons (N is number of buttons)
+
+      if (packet.size != m_metaData.packageSize) {
+        return false;
+      }
+
+      const auto packetID = getBits(packet, 0, 4) | getBits(packet, 4, 4) << 4;
+      if (packetID != m_metaData.deviceID) {
+        return false;
+      }
+
+      State state;
+      uint16_t offset = 8u;
+
+      uint8_t axis = 0u;
+      for (auto i = 0u; i < m_metaData.num10bitAxes; i++, axis++) {
+        state.axes[axis] = mapAxisValue(axis, getBits(packet, offset, 10), 10);
+        offset += 10;
+      }
+
+      for (auto i = 0u; i < m_metaData.num8bitAxes; i++, axis++) {
+        state.axes[axis] = mapAxisValue(axis, getBits(packet, offset, 8), 8);
+        offset += 8;
+      }
 
-      const auto hatResolution = getHatResolution();
-      state.hat = mapHatValue(getBits(packet, offset, hatResolution));
-      offset += hatResolution;
+      uint16_t button = 0u;
+      for (auto i = 0u; i < m_metaData.numPrimaryButtons; i++) {
+        state.buttons |= getBits(packet, offset++, 1) << button++;
+      }
+
+      if (m_metaData.hasHat) {
 
-      // Secondary hats are all shown as dual axes
-      for (auto i = 0u; i < m_metaData.numSecondaryHats; i++, axis += 2) {
-        const auto value = mapHatValue(getBits(packet, offset, hatResolution));
+        const auto hatResolution = getHatResolution();
+        state.hat = mapHatValue(getBits(packet, offset, hatResolution));
         offset += hatResolution;
-        static constexpr uint16_t dx[] = { 511, 511, 1023, 1023, 1023, 511, 0, 0, 0 };
-        static constexpr uint16_t dy[] = { 511, 0, 0, 511, 1023, 1023, 1023, 511, 0 };
-        state.axes[axis + 0] = dx[value];
-        state.axes[axis + 1] = dy[value];
+
+        // Secondary hats are all shown as dual axes
+        for (auto i = 0u; i < m_metaData.numSecondaryHats; i++, axis += 2) {
+          const auto value = mapHatValue(getBits(packet, offset, hatResolution));
+          offset += hatResolution;
+          static const uint8_t dx[] PROGMEM = { 1, 1, 2, 2, 2, 1, 0, 0, 0 };
+          static const uint8_t dy[] PROGMEM = { 1, 0, 0, 1, 2, 2, 2, 1, 0 };
+          state.axes[axis + 0] = Flash::read(dx[value]);
+          state.axes[axis + 1] = Flash::read(dy[value]);
+        }
+      }
+
+      for (auto i = 0u; i < m_metaData.numSecondaryButtons; i++) {
+        state.buttons |= getBits(packet, offset++, 1) << button++;
+      }
+
+      // If the device is a Logitech ThunderPad Digital, manually remap up, down, left and right buttons to X and Y axes
+      if(m_metaData.deviceID == DEVICE_THUNDERPAD_DIGITAL){
+        const auto value = getBits(packet, 12, 4);
+        static const uint8_t dx[] PROGMEM = { 1, 0, 1, 0, 2, 1, 2, 1, 1, 0, 1, 0, 2, 1, 2, 1 };
+        static const uint8_t dy[] PROGMEM = { 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1 };
+        state.axes[0] = Flash::read(dx[value]);
+        state.axes[1] = Flash::read(dy[value]);
+
+        state.buttons &= 0xFF0F;
+        state.buttons |= (state.buttons & 0x0F00) >> 4;
+      }
+      // If the device is a Logitech WingMan Gamepad, manually remap up, down, left and right buttons to X and Y axes
+      else if(m_metaData.deviceID == DEVICE_WINGMAN_GAMEPAD){
+        const auto value = getBits(packet, 8, 4);
+        static const uint8_t dx[] PROGMEM = { 1, 0, 1, 0, 2, 1, 2, 1, 1, 0, 1, 0, 2, 1, 2, 1 };
+        static const uint8_t dy[] PROGMEM = { 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1 };
+        state.axes[0] = Flash::read(dx[value]);
+        state.axes[1] = Flash::read(dy[value]);
+
+        state.buttons >>= 4;
       }
+
+      state.buttons = m_debouncer.update(state.buttons);
+      m_state = state;
+      return true;
     }
 
-    for (auto i = 0u; i < m_metaData.numSecondaryButtons; i++) {
-      state.buttons |= getBits(packet, offset++, 1) << button++;
+    const State &getState() const override {
+      return m_state;
     }
 
-    // If the device is a Logitech ThunderPad Digital, manually remap up, down, left and right buttons to X and Y axes
-    if(m_metaData.deviceID == DEVICE_THUNDERPAD_DIGITAL){
-      const auto value = getBits(packet, 12, 4);
-      static constexpr uint16_t dx[] = { 511, 0, 511, 0, 1023, 511, 1023, 511, 511, 0, 511, 0, 1023, 511, 1023, 511 };
-      static constexpr uint16_t dy[] = { 511, 511, 1023, 1023, 511, 511, 1023, 1023, 0, 0, 511, 511, 0, 0, 511, 511 };
-      state.axes[0] = dx[value]; 
-      state.axes[1] = dy[value];
+    Description getDescription() const override {
+      return m_description;
+    }
 
-      state.buttons &= 0xFF0F;
-      state.buttons |= (state.buttons & 0x0F00) >> 4;
+  private:
+    struct MetaData {
+      uint8_t deviceID{};
+      uint8_t packageSize{};
+      uint8_t num8bitAxes{};
+      uint8_t num10bitAxes{};
+      uint8_t numPrimaryButtons{};
+      uint8_t numSecondaryButtons{};
+      uint8_t numSecondaryHats{};
+      uint8_t hasHat{};
+      uint8_t numHatDirections{};
+    };
+
+    // Logitech Device ID constants, taken from the Linux Kernel ADI driver
+    enum LogitechDevices{
+      DEVICE_WINGMAN_EXTREME_DIGITAL    = 0x00,
+      DEVICE_THUNDERPAD_DIGITAL         = 0x01,
+      DEVICE_SIDECAR                    = 0x02,
+      DEVICE_CYBERMAN2                  = 0x03,
+      DEVICE_WINGMAN_INTERCEPTOR        = 0x04,
+      DEVICE_WINGMAN_FORMULA            = 0x05,
+      DEVICE_WINGMAN_GAMEPAD            = 0x06,
+      DEVICE_WINGMAN_EXTREME_DIGITAL_3D = 0x07,
+      DEVICE_WINGMAN_GAMEPAD_EXTREME    = 0x08,
+      DEVICE_WINGMAN_GAMEPAD_USB        = 0x09
+    };
+
+    MetaData m_metaData;
+    Description m_description{};
+    State m_state;
+    Debouncer<> m_debouncer;
+    /// Number of calibrated analog axes, the CyberMan 2 has the most of them.
+    /// Further axes are reported raw, the limits are too large to have them
+    /// for every axis of both devices.
+    static const uint8_t MAX_ANALOG_AXES{6};
+
+    AxisLimits m_limits[MAX_ANALOG_AXES];
+    uint16_t m_scales[MAX_ANALOG_AXES];
+
+    /// Fractional bits of the scales. The limits span at least the half of
+    /// the raw range, so the scales stay below 2 and fit into 16 bits.
+    static const uint8_t SCALE_BITS{14};
+
+    /// The limits never shrink below the middle half of the axis resolution.
+    static uint16_t getInnerMin(uint8_t bits) {
+      return 1u << (bits - 2u);
     }
-    // If the device is a Logitech WingMan Gamepad, manually remap up, down, left and right buttons to X and Y axes
-    else if(m_metaData.deviceID == DEVICE_WINGMAN_GAMEPAD){
-      const auto value = getBits(packet, 8, 4);
-      static constexpr uint16_t dx[] = { 511, 0, 511, 0, 1023, 511, 1023, 511, 511, 0, 511, 0, 1023, 511, 1023, 511 };
-      static constexpr uint16_t dy[] = { 511, 511, 1023, 1023, 511, 511, 1023, 1023, 0, 0, 511, 511, 0, 0, 511, 511 };
-      state.axes[0] = dx[value]; 
-      state.axes[1] = dy[value];
-
-      state.buttons >>= 4;
+
+    static uint16_t getInnerMax(uint8_t bits) {
+      return 3u << (bits - 2u);
     }
 
-    m_state = state;
-    return true;
-  }
+    void resetLimits(uint8_t axis, uint8_t bits) {
+      if (axis < MAX_ANALOG_AXES) {
+        m_limits[axis].reset(getInnerMin(bits), getInnerMax(bits));
+      }
+    }
 
-  const State &getState() const override {
-    return m_state;
-  }
+    void updateScale(uint8_t axis) {
+      const auto &limits = m_limits[axis];
+      m_scales[axis] = AxisLimits::getScale(m_description.axisMax[axis], limits.getMax() - limits.getMin(), SCALE_BITS);
+    }
 
-  const Description &getDescription() const override {
-    return m_description;
-  }
+    uint16_t mapAxisValue(uint8_t axis, uint16_t value, uint8_t bits) {
+      if (axis >= MAX_ANALOG_AXES) {
+        return value;
+      }
+      auto &limits = m_limits[axis];
+      if (limits.update(value, getInnerMin(bits), getInnerMax(bits))) {
+        updateScale(axis);
+      }
+      return uint32_t(limits.clamp(value) - limits.getMin()) * m_scales[axis] >> SCALE_BITS;
+    }
 
-private:
-  struct MetaData {
-    char deviceName[32]{};
-    uint8_t deviceID{};
-    uint8_t packageSize{};
-    uint8_t num8bitAxes{};
-    uint8_t num10bitAxes{};
-    uint8_t numPrimaryButtons{};
-    uint8_t numSecondaryButtons{};
-    uint8_t numSecondaryHats{};
-    uint8_t hasHat{};
-    uint8_t numHatDirections{};
-  };
+    uint8_t mapHatValue(uint16_t value) const {
+      return map(value, 0, m_metaData.numHatDirections, 0, 8);
+    }
 
-  struct Limits {
-    uint16_t min, max;
-  };
+    uint8_t getHatResolution() const {
+      uint8_t result = 0u;
+      for (auto value = m_metaData.numHatDirections; value; value >>= 1) {
+        result++;
+      }
+      return result;
+    }
 
-  // Logitech Device ID constants, taken from the Linux Kernel ADI driver
-  enum LogitechDevices{
-    DEVICE_WINGMAN_EXTREME_DIGITAL    = 0x00,
-    DEVICE_THUNDERPAD_DIGITAL         = 0x01,
-    DEVICE_SIDECAR                    = 0x02,
-    DEVICE_CYBERMAN2                  = 0x03,
-    DEVICE_WINGMAN_INTERCEPTOR        = 0x04,
-    DEVICE_WINGMAN_FORMULA            = 0x05,
-    DEVICE_WINGMAN_GAMEPAD            = 0x06,
-    DEVICE_WINGMAN_EXTREME_DIGITAL_3D = 0x07,
-    DEVICE_WINGMAN_GAMEPAD_EXTREME    = 0x08,
-    DEVICE_WINGMAN_GAMEPAD_USB        = 0x09
-  };
+    bool readMetaData(const Packet &packet) {
+
+      // === Metadata packet format ===
+      //
+      // Offset Bits Description
+      // --------------------------------------------------------
+      // 0      10   Metadata package size
+      // 10     4    Low nibble of the Device ID
+      // 14     4    High nibble of the Device ID
+      // 18     4    Feature flags
+      // 22     10   Status package size
+      // 32     4    Number of axes (0..15)
+      // 36     6    Number of buttons (0..63)
+      // 42     6    Number of hat directions (0..63)
+      // 48     6    Number of secondary buttons (0..63)
+      // 54     4    Number of secondary hats (0..15)
+      // 58     4    Number of 8-bit axes (0..15)
+      // 62     4    Length of the cname in bytes (0..15)
+      // 66     8*N  Characters of the cname (N is the length)
+
+      // === Flags ===
+      //
+      // Bit Description
+      // ---------------------
+      // 1   Reserved
+      // 2   Reserved
+      // 3   Has Hat
+      // 4   Has 10-bit axes
+
+      if (packet.size == 0) {
+        return false;
+      }
 
-  uint16_t mapAxisValue(uint8_t axis, uint16_t value) {
-    if (value < m_limits[axis].min) {
-      m_limits[axis].min = value;
-    } else if (value > m_limits[axis].max) {
-      m_limits[axis].max = value;
-    }
-    return map(value, m_limits[axis].min, m_limits[axis].max, 0, 1023);
-  }
+      const auto metaSize = getBits(packet, 0, 10);
+      if (metaSize != packet.size) {
+        log("Meta data package size mismatch, expected %d but got %d", packet.size, metaSize);
+        return false;
+      }
 
-  uint8_t mapHatValue(uint16_t value) const {
-    return map(value, 0, m_metaData.numHatDirections, 0, 8);
-  }
+      m_metaData.deviceID = getBits(packet, 10, 4) | getBits(packet, 14, 4) << 4;
+      const auto flags = getBits(packet, 18, 4);
+      m_metaData.hasHat = flags & 0x4;
+      m_metaData.packageSize = getBits(packet, 22, 10);
+      const auto numTotalAxes = getBits(packet, 32, 4);
+      m_metaData.numPrimaryButtons = getBits(packet, 36, 6);
+      m_metaData.numHatDirections = getBits(packet, 42, 6);
+      m_metaData.numSecondaryButtons = getBits(packet, 48, 6);
+      m_metaData.numSecondaryHats = getBits(packet, 54, 4);
+      const auto num8bitAxes = getBits(packet, 58, 4);
+      if (flags & 0x8) {
+        m_metaData.num10bitAxes = numTotalAxes - num8bitAxes;
+        m_metaData.num8bitAxes = num8bitAxes;
+      } else {
+        m_metaData.num8bitAxes = numTotalAxes;
+        m_metaData.num10bitAxes = 0u;
+      }
 
-  uint8_t getHatResolution() const {
-    uint8_t result = 0u;
-    for (auto value = m_metaData.numHatDirections; value; value >>= 1) {
-      result++;
+      return true;
     }
-    return result;
-  }
 
-  /// Internal bit structure which is filled by reading from the joystick.
-  using Packet = Buffer<255>;
+    /// Gets the device name by the device ID.
+    ///
+    /// The name is taken from a table in the program memory, same as in
+    /// the Linux ADI driver. The cname from the metadata packet would need
+    /// a buffer in RAM for every device.
+    static const char *getDeviceName(uint8_t deviceID) {
+      static const char extremeDigital[] PROGMEM = "Logitech WingMan Extreme Digital";
+      static const char thunderPad[] PROGMEM = "Logitech ThunderPad Digital";
+      static const char sideCar[] PROGMEM = "Logitech SideCar";
+      static const char cyberMan[] PROGMEM = "Logitech CyberMan 2";
+      static const char interceptor[] PROGMEM = "Logitech WingMan Interceptor";
+      static const char formula[] PROGMEM = "Logitech WingMan Formula";
+      static const char gamePad[] PROGMEM = "Logitech WingMan GamePad";
+      static const char extremeDigital3D[] PROGMEM = "Logitech WingMan Extreme Digital 3D";
+      static const char gamePadExtreme[] PROGMEM = "Logitech WingMan GamePad Extreme";
+      static const char gamePadUSB[] PROGMEM = "Logitech WingMan GamePad USB";
+      static const char unknown[] PROGMEM = "Logitech Unknown";
+      static const char *const names[] PROGMEM = {
+          extremeDigital, thunderPad, sideCar, cyberMan, interceptor,
+          formula, gamePad, extremeDigital3D, gamePadExtreme, gamePadUSB,
+      };
+      return Flash::read(names, deviceID, static_cast<const char *>(unknown));
+    }
+  };
 
   static uint16_t getBits(const Packet& packet, uint8_t offset, uint8_t count) {
     uint16_t result = 0u;
@@ -235,123 +468,84 @@ private:
   }
 
   DigitalOutput<GamePort<3>::pin> m_trigger;
-  DigitalInput<GamePort<2>::pin, true> m_data0;
-  DigitalInput<GamePort<7>::pin, true> m_data1;
-  MetaData m_metaData;
-  Description m_description;
-  State m_state;
-  Limits m_limits[Joystick::MAX_AXES];
+  PinGroup<GamePort<2>::pin, GamePort<7>::pin, GamePort<10>::pin, GamePort<14>::pin> m_data;
+  Device m_devices[MAX_DEVICES];
+  bool m_chained{};
+  unsigned long m_lastRead{};
+
+  /// Waits until the devices cooled down since the last read.
+  ///
+  /// Cyberman 2 seems not to work properly if the packets are read too
+  /// fast. Instead of a fixed delay, only the rest of the time since the
+  /// last read is waited, so the time spent on the USB transfer counts.
+  void cooldown() const {
+    const unsigned long duration = Config::get().logitechCooldown;
+    while (micros() - m_lastRead < duration)
+      ;
+  }
 
   void enableDigitalMode() const {
-    static constexpr uint16_t seq[] = {4, 2, 3, 10, 6, 11, 7, 9, 11, 0};
+    static const uint16_t seq[] PROGMEM = {4, 2, 3, 10, 6, 11, 7, 9, 11, 0};
     
     // Some devices, as the Logitech ThunderPad Digital, require some time for its
     // microcontroller to initialize; otherwise the enableDigitalMode command is skipped
-    // and the device stays in analog mode. Don't use values higher than 100ms, they could
+    // and the device stays in analog mode. The device is powered together with the
+    // adapter, so only the rest of the power-up time is waited, which is mostly spent
+    // on the USB enumeration anyway. Don't use values higher than 100ms, they could
     // interfere with the USB initialization
-    delay(100);
+    const unsigned long powerUpTime = Config::get().logitechPowerUp;
+    while (millis() < powerUpTime)
+      ;
     
-    for (auto i = 0u; seq[i]; i++) {
+    for (auto i = 0u; const auto duration = Flash::read(seq[i]); i++) {
       m_trigger.pulse(20u);
-      delay(seq[i]);
+      delay(duration);
     }
   }
 
   byte readData() const {
-    const auto b0 = m_data0.read();
-    const auto b1 = m_data1.read();
-    return bool(b0) | bool(b1) << 1;
+    return m_data.read();
   }
 
-  Packet readPacket() const {
-    static constexpr auto TIMEOUT = 32u;
-    auto timeout = TIMEOUT;
-    auto first = true;
-    Packet packet;
-    const InterruptStopper noirq;
+  /// Reads the packets of both devices in one trigger cycle.
+  ///
+  /// Every device strobes its bits on its own pair of data lines, so
+  /// the edges are tracked separately, while the timeout is shared and
+  /// expires only if none of the devices is sending anymore.
+  void readPackets(Packets &packets) const {
+    // Timeouts, by default the same as ADI_MAX_START and ADI_MAX_STROBE
+    // in the Linux driver.
+    const auto strobe = Timer::fromMicros(Config::get().logitechStrobe);
+    auto timeout = Timer::fromMicros(Config::get().logitechStart);
+    bool first[MAX_DEVICES] = {true, true};
+    const LongInterruptStopper noirq;
     auto last = readData();
     m_trigger.setHigh();
-    while (timeout-- && packet.size < Packet::MAX_SIZE) {
+    auto start = Timer::now();
+    while (Timer::since(start) < timeout) {
       const auto next = readData();
-      const auto edge = last ^ next;
+      auto edge = last ^ next;
       if (edge) {
-        if (first) {
-          first = false;
-        } else {
-          // Normally both data bits should never flip simultaneously.
-          // We should get either 10, when data1 has flipped, or 01,
-          // when data0 has flipped. So if we just shift the edge to
-          // the right once, we will get the needed 1 or 0 bit value.
-          packet.data[packet.size++] = edge >> 1;
+        for (auto i = 0u; i < MAX_DEVICES; i++, edge >>= 2) {
+          auto &packet = packets.device[i];
+          if (!(edge & 0b11) || packet.size >= Packet::MAX_SIZE) {
+            continue;
+          }
+          if (first[i]) {
+            first[i] = false;
+          } else {
+            // Normally both data bits should never flip simultaneously.
+            // We should get either 10, when data1 has flipped, or 01,
+            // when data0 has flipped. So if we just shift the edge to
+            // the right once, we will get the needed 1 or 0 bit value.
+            packet.data[packet.size++] = (edge & 0b11) >> 1;
+          }
         }
         last = next;
-        timeout = TIMEOUT;
+        start = Timer::now();
+        timeout = strobe;
       }
     }
     m_trigger.setLow();
-    return packet;
-  }
-
-  bool readMetaData() {
-
-    // === Metadata packet format ===
-    //
-    // Offset Bits Description
-    // --------------------------------------------------------
-    // 0      10   Metadata package size
-    // 10     4    Low nibble of the Device ID
-    // 14     4    High nibble of the Device ID
-    // 18     4    Feature flags
-    // 22     10   Status package size
-    // 32     4    Number of axes (0..15)
-    // 36     6    Number of buttons (0..63)
-    // 42     6    Number of hat directions (0..63)
-    // 48     6    Number of secondary buttons (0..63)
-    // 54     4    Number of secondary hats (0..15)
-    // 58     4    Number of 8-bit axes (0..15)
-    // 62     4    Length of the cname in bytes (0..15)
-    // 66     8*N  Characters of the cname (N is the length)
-
-    // === Flags ===
-    //
-    // Bit Description
-    // ---------------------
-    // 1   Reserved
-    // 2   Reserved
-    // 3   Has Hat
-    // 4   Has 10-bit axes
-
-    const auto packet = readPacket();
-
-    const auto metaSize = getBits(packet, 0, 10);
-    if (metaSize != packet.size) {
-      log("Meta data package size mismatch, expected %d but got %d", packet.size, metaSize);
-      return false;
-    }
-
-    m_metaData.deviceID = getBits(packet, 10, 4) | getBits(packet, 14, 4) << 4;
-    const auto flags = getBits(packet, 18, 4);
-    m_metaData.hasHat = flags & 0x4;
-    m_metaData.packageSize = getBits(packet, 22, 10);
-    const auto numTotalAxes = getBits(packet, 32, 4);
-    m_metaData.numPrimaryButtons = getBits(packet, 36, 6);
-    m_metaData.numHatDirections = getBits(packet, 42, 6);
-    m_metaData.numSecondaryButtons = getBits(packet, 48, 6);
-    m_metaData.numSecondaryHats = getBits(packet, 54, 4);
-    const auto num8bitAxes = getBits(packet, 58, 4);
-    if (flags & 0x8) {
-      m_metaData.num10bitAxes = numTotalAxes - num8bitAxes;
-      m_metaData.num8bitAxes = num8bitAxes;
-    } else {
-      m_metaData.num8bitAxes = numTotalAxes;
-      m_metaData.num10bitAxes = 0u;
-    }
-    const auto cnameLength = getBits(packet, 62, 4);
-    m_metaData.deviceName[cnameLength] = 0;
-    for (auto i = 0u; i < cnameLength; i++) {
-      m_metaData.deviceName[i] = getBits(packet, 66 + 8 * i, 8);
-    }
-
-    return true;
   }
 };
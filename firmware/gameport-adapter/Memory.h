@@ -0,0 +1,149 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HidDevice.h"
+#include <Arduino.h>
+#include <new.h>
+
+/// Symbols provided by the linker.
+extern uint8_t __heap_start;
+extern uint8_t __stack;
+
+/// RAM usage instrumentation.
+///
+/// The free RAM between the static data and the stack is painted with a
+/// known pattern at startup. The stack overwrites the pattern as it grows,
+/// so the deepest stack usage ever reached can be found later by looking
+/// for the first byte, which doesn't match the pattern anymore.
+class Memory {
+public:
+  /// Size of the shared scratch arena in bytes.
+  static const uint16_t SCRATCH_SIZE{512u};
+
+  /// Budget for the driver together with the HID joystick in bytes.
+  static const uint16_t DRIVER_BUDGET{1024u};
+
+  /// Object in the shared scratch arena (RAII).
+  ///
+  /// Only one driver is active at a time and the large packet buffers are
+  /// needed just during a single update, so all of them share one static
+  /// arena instead of piling up on the stack. Only one scratch object may
+  /// exist at a time.
+  template <typename T>
+  class Scratch {
+  public:
+    Scratch()
+    : m_object(new (getArena()) T{}) {
+      static_assert(sizeof(T) <= SCRATCH_SIZE, "Scratch arena is too small");
+    }
+
+    ~Scratch() {
+      m_object->~T();
+    }
+
+    Scratch(const Scratch &) = delete;
+    Scratch(Scratch &&) = delete;
+    Scratch &operator=(const Scratch &) = delete;
+    Scratch &operator=(Scratch &&) = delete;
+
+    T &operator*() const {
+      return *m_object;
+    }
+
+    T *operator->() const {
+      return m_object;
+    }
+
+  private:
+    T *const m_object;
+  };
+
+  /// Gets the size of the static data (.data, .bss and .noinit) in bytes.
+  static uint16_t getStaticSize() {
+    return &__heap_start - reinterpret_cast<uint8_t *>(RAMSTART);
+  }
+
+  /// Gets the deepest stack usage since startup in bytes.
+  static uint16_t getStackPeak() {
+    return &__stack - &__heap_start + 1 - getUntouched();
+  }
+
+  /// Gets the amount of RAM, which was never used since startup in bytes.
+  static uint16_t getUntouched() {
+    auto p = &__heap_start;
+    while (p <= &__stack && *p == PAINT) {
+      p++;
+    }
+    return p - &__heap_start;
+  }
+
+  /// HID feature report with the RAM usage.
+  ///
+  /// The report contains the format version followed by the total RAM,
+  /// the static data, the stack peak, the untouched RAM and the scratch
+  /// arena size, all as 16 bit little endian values in bytes.
+  class Report : public VendorFeature {
+  public:
+    static const uint8_t ID{0x13};
+
+    Report()
+    : VendorFeature(ID, 1 + NUM_VALUES * sizeof(uint16_t)) {
+    }
+
+    int send() override {
+      const uint8_t version = VERSION;
+      const uint16_t values[NUM_VALUES] = {
+          RAMEND - RAMSTART + 1, getStaticSize(), getStackPeak(), getUntouched(), SCRATCH_SIZE,
+      };
+      const auto res1 = USB_SendControl(0, &version, sizeof(version));
+      const auto res2 = USB_SendControl(0, values, sizeof(values));
+      if (res1 < 0 || res2 < 0) {
+        return -1;
+      }
+      return res1 + res2;
+    }
+
+  private:
+    static const uint8_t VERSION{1};
+    static const uint8_t NUM_VALUES{5};
+  };
+
+  /// Pattern of the free RAM.
+  static const uint8_t PAINT{0xc5};
+
+private:
+
+  static void *getArena() {
+    // All the scratch objects are byte buffers, which need no alignment on AVR
+    static uint8_t arena[SCRATCH_SIZE];
+    return arena;
+  }
+};
+
+/// Paints the free RAM.
+///
+/// Runs from the .init3 section, before the global objects are constructed
+/// and before the stack is used by anything else. The host tests have no
+/// such section.
+#ifdef __AVR__
+__attribute__((naked, used, section(".init3"))) static void paintMemory() {
+  for (auto p = &__heap_start; p <= &__stack; p++) {
+    *p = Memory::PAINT;
+  }
+}
+#endif
@@ -0,0 +1,234 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Flash.h"
+#include "MidiPort.h"
+#include <Arduino.h>
+#include <PluggableUSB.h>
+
+/// USB MIDI device.
+///
+/// Bridges the MIDI port of the game port to a USB MIDI streaming
+/// interface, which is exposed next to the HID joystick. The USB side
+/// transfers 4 byte event packets, while the serial side is a byte stream
+/// with running status. The conversion happens in poll(), which never
+/// waits for the USB host or the serial line, so the joystick updates are
+/// not delayed.
+class MidiDevice : public PluggableUSBModule {
+public:
+  MidiDevice()
+  : PluggableUSBModule(2, 2, m_endpointTypes) {
+    PluggableUSB().plug(this);
+  }
+
+  /// Starts the serial MIDI port.
+  void init() {
+    MidiPort::init();
+  }
+
+  /// Transfers the pending data in both directions.
+  void poll() {
+    receive();
+    send();
+  }
+
+protected:
+  bool setup(USBSetup &) override {
+    return false;
+  }
+
+  int getInterface(uint8_t *interfaceCount) override {
+    *interfaceCount += 2; // uses 2
+    const uint8_t control = pluggedInterface;
+    const uint8_t streaming = pluggedInterface + 1;
+    const uint8_t out = USB_ENDPOINT_OUT(getOutEndpoint());
+    const uint8_t in = USB_ENDPOINT_IN(getInEndpoint());
+    const uint8_t descriptor[] = {
+        // Interface association
+        0x08, 0x0b, control, 0x02, AUDIO, AUDIO_CONTROL, 0x00, 0x00,
+        // Audio control interface, class specific header
+        0x09, 0x04, control, 0x00, 0x00, AUDIO, AUDIO_CONTROL, 0x00, 0x00,
+        0x09, 0x24, 0x01, 0x00, 0x01, 0x09, 0x00, 0x01, streaming,
+        // MIDI streaming interface, class specific header
+        0x09, 0x04, streaming, 0x00, 0x02, AUDIO, MIDI_STREAMING, 0x00, 0x00,
+        0x07, 0x24, 0x01, 0x00, 0x01, 0x41, 0x00,
+        // Embedded and external MIDI IN jacks (1, 2)
+        0x06, 0x24, 0x02, JACK_EMBEDDED, 0x01, 0x00,
+        0x06, 0x24, 0x02, JACK_EXTERNAL, 0x02, 0x00,
+        // Embedded and external MIDI OUT jacks (3, 4), connected crosswise
+        0x09, 0x24, 0x03, JACK_EMBEDDED, 0x03, 0x01, 0x02, 0x01, 0x00,
+        0x09, 0x24, 0x03, JACK_EXTERNAL, 0x04, 0x01, 0x01, 0x01, 0x00,
+        // Bulk OUT endpoint to the embedded IN jack
+        0x09, 0x05, out, USB_ENDPOINT_TYPE_BULK, USB_EP_SIZE, 0x00, 0x00, 0x00, 0x00,
+        0x05, 0x25, 0x01, 0x01, 0x01,
+        // Bulk IN endpoint from the embedded OUT jack
+        0x09, 0x05, in, USB_ENDPOINT_TYPE_BULK, USB_EP_SIZE, 0x00, 0x00, 0x00, 0x00,
+        0x05, 0x25, 0x01, 0x01, 0x03,
+    };
+    return USB_SendControl(0, descriptor, sizeof(descriptor));
+  }
+
+  int getDescriptor(USBSetup &) override {
+    return 0;
+  }
+
+private:
+  static const uint8_t AUDIO{0x01};
+  static const uint8_t AUDIO_CONTROL{0x01};
+  static const uint8_t MIDI_STREAMING{0x03};
+  static const uint8_t JACK_EMBEDDED{0x01};
+  static const uint8_t JACK_EXTERNAL{0x02};
+  static const uint8_t PACKET_SIZE{4};
+  static const uint8_t BUFFER_SIZE{USB_EP_SIZE};
+
+  /// Converts the serial byte stream into USB MIDI event packets.
+  class Parser {
+  public:
+    /// Adds a received byte.
+    /// @param[out] packet is filled, if a message is complete
+    /// @returns true if the packet was filled
+    bool parse(uint8_t value, uint8_t *packet) {
+      // Real time messages may appear everywhere, even within other messages
+      if (value >= 0xf8) {
+        return fill(packet, 0x0f, value, 0x00, 0x00);
+      }
+
+      if (value == 0xf0) {
+        m_status = value;
+        m_data[0] = value;
+        m_count = 1u;
+        return false;
+      }
+
+      if (value == 0xf7) {
+        if (m_status != 0xf0) {
+          return false;
+        }
+        m_data[m_count++] = value;
+        const auto count = m_count;
+        m_status = 0u;
+        m_count = 0u;
+        return fill(packet, 0x04 + count, m_data[0], count > 1 ? m_data[1] : 0x00, count > 2 ? m_data[2] : 0x00);
+      }
+
+      if (value >= 0x80) {
+        m_count = 0u;
+        m_status = value;
+        if (value < 0xf0) {
+          m_expected = (value & 0xe0) == 0xc0 ? 1u : 2u;
+          return false;
+        }
+        // System common messages cancel the running status
+        m_expected = value == 0xf2 ? 2u : (value == 0xf1 || value == 0xf3) ? 1u : 0u;
+        if (value == 0xf6) {
+          m_status = 0u;
+          return fill(packet, 0x05, value, 0x00, 0x00);
+        }
+        if (!m_expected) {
+          m_status = 0u;
+        }
+        return false;
+      }
+
+      if (m_status == 0xf0) {
+        m_data[m_count++] = value;
+        if (m_count < 3u) {
+          return false;
+        }
+        m_count = 0u;
+        return fill(packet, 0x04, m_data[0], m_data[1], m_data[2]);
+      }
+
+      if (!m_status) {
+        return false;
+      }
+
+      m_data[m_count++] = value;
+      if (m_count < m_expected) {
+        return false;
+      }
+      m_count = 0u;
+      const auto status = m_status;
+      if (status >= 0xf0) {
+        m_status = 0u;
+        return fill(packet, m_expected + 1u, status, m_data[0], m_expected > 1 ? m_data[1] : 0x00);
+      }
+      return fill(packet, status >> 4, status, m_data[0], m_expected > 1 ? m_data[1] : 0x00);
+    }
+
+  private:
+    uint8_t m_status{};
+    uint8_t m_expected{};
+    uint8_t m_count{};
+    uint8_t m_data[3]{};
+
+    static bool fill(uint8_t *packet, uint8_t cin, uint8_t byte1, uint8_t byte2, uint8_t byte3) {
+      packet[0] = cin;
+      packet[1] = byte1;
+      packet[2] = byte2;
+      packet[3] = byte3;
+      return true;
+    }
+  };
+
+  uint8_t m_endpointTypes[2]{EP_TYPE_BULK_OUT, EP_TYPE_BULK_IN};
+  Parser m_parser;
+  uint8_t m_buffer[BUFFER_SIZE]{};
+  uint8_t m_size{};
+
+  uint8_t getOutEndpoint() const {
+    return pluggedEndpoint;
+  }
+
+  uint8_t getInEndpoint() const {
+    return pluggedEndpoint + 1;
+  }
+
+  /// Forwards the packets from the host to the serial port.
+  ///
+  /// Only whole packets are taken, which surely fit into the send buffer
+  /// of the serial port. The rest stays in the USB endpoint, so the host
+  /// is throttled to the speed of the serial line.
+  void receive() {
+    while (USB_Available(getOutEndpoint()) >= PACKET_SIZE && MidiPort::getWriteSpace() >= 3u) {
+      uint8_t packet[PACKET_SIZE];
+      if (USB_Recv(getOutEndpoint(), packet, sizeof(packet)) != PACKET_SIZE) {
+        return;
+      }
+      static const uint8_t sizes[16] PROGMEM = {0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1};
+      MidiPort::writeMessage(packet + 1, Flash::read(sizes, packet[0] & 0x0f));
+    }
+  }
+
+  /// Forwards the received serial data to the host.
+  ///
+  /// All the messages received since the last call are batched into one
+  /// USB transfer. It is only sent, if the endpoint has space for it.
+  void send() {
+    uint8_t value;
+    while (m_size + PACKET_SIZE <= BUFFER_SIZE && MidiPort::read(value)) {
+      if (m_parser.parse(value, m_buffer + m_size)) {
+        m_size += PACKET_SIZE;
+      }
+    }
+    if (m_size && USBDevice.configured() && USB_SendSpace(getInEndpoint()) >= m_size) {
+      USB_Send(getInEndpoint() | TRANSFER_RELEASE, m_buffer, m_size);
+      m_size = 0u;
+    }
+  }
+};
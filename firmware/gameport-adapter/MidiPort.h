@@ -0,0 +1,256 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "DigitalPin.h"
+#include "GamePort.h"
+#include "RingBuffer.h"
+#include "Timer.h"
+#include "Utilities.h"
+#include <Arduino.h>
+
+/// Serial MIDI port on the game port.
+///
+/// The MIDI lines of the game port are not connected to the hardware UART
+/// of the ATmega32U4, so the UART is implemented in software. The bits are
+/// timed by the compare units B (receive) and C (transmit) of Timer1, which
+/// keeps running freely for the joystick protocols. The start bit of an
+/// incoming byte is detected by a pin change interrupt. Both directions are
+/// buffered, so the main loop never waits for the slow serial line.
+/// @remark The digital joystick protocols disable the interrupts for longer
+///         than a bit while reading a packet. The transmitter finishes the
+///         current byte before and holds back the next ones until the
+///         packet was read, but a byte received at that time is dropped.
+class MidiPort {
+public:
+  static const uint16_t BAUD_RATE{31250u};
+
+  /// Starts the port, has to be called after Timer::init().
+  static void init() {
+    auto &port = getPort();
+    port.tx.setHigh();
+    pinMode(RX_PIN, INPUT_PULLUP);
+    PCMSK0 |= _BV(pinBit(RX_PIN));
+    PCIFR = _BV(PCIF0);
+    PCICR |= _BV(PCIE0);
+    LongInterruptStopper::setHandler(onLongInterruptStop);
+  }
+
+  /// Queues a byte for sending.
+  /// @returns false if the send buffer is full
+  static bool write(uint8_t value) {
+    auto &port = getPort();
+    if (!port.txBuffer.push(value)) {
+      return false;
+    }
+    if (!port.txHold) {
+      startTransmitter();
+    }
+    return true;
+  }
+
+  /// Queues a whole message for sending.
+  ///
+  /// The status byte of channel messages is skipped, as long as it
+  /// doesn't change (running status), which saves a third of the
+  /// bandwidth on the slow serial line for notes and controllers.
+  /// @returns false if the message doesn't fit into the send buffer
+  static bool writeMessage(const uint8_t *data, uint8_t size) {
+    auto &port = getPort();
+    const auto status = size ? data[0] : 0u;
+    const auto running = status >= 0x80 && status < 0xf0 && status == port.txStatus;
+    if (running) {
+      data++;
+      size--;
+    }
+    if (size > getWriteSpace()) {
+      return false;
+    }
+    if (status >= 0x80 && status < 0xf8) {
+      port.txStatus = status;
+    }
+    while (size--) {
+      write(*data++);
+    }
+    return true;
+  }
+
+  /// Gets the number of bytes, which can be queued for sending.
+  static uint8_t getWriteSpace() {
+    return getPort().txBuffer.getSpace();
+  }
+
+  /// Takes the oldest received byte.
+  /// @returns false if nothing was received
+  static bool read(uint8_t &value) {
+    return getPort().rxBuffer.pop(value);
+  }
+
+  /// Handles the start bit (pin change interrupt).
+  static void onStartBit() {
+    if (PINB & _BV(pinBit(RX_PIN))) {
+      return;
+    }
+    auto &port = getPort();
+    PCMSK0 &= ~_BV(pinBit(RX_PIN));
+    port.rxBits = 0u;
+    port.rxData = 0u;
+    // Sample in the middle of the bits
+    OCR1B = Timer::now() + BIT_TICKS + BIT_TICKS / 2u;
+    TIFR1 = _BV(OCF1B);
+    TIMSK1 |= _BV(OCIE1B);
+  }
+
+  /// Samples the next received bit (compare B interrupt).
+  static void onReceiveTimer() {
+    auto &port = getPort();
+    const auto bit = PINB & _BV(pinBit(RX_PIN));
+    if (isLate(OCR1B)) {
+      // The bits were missed, wait for the next start bit
+      stopReceiver();
+      return;
+    }
+    if (port.rxBits < 8u) {
+      port.rxData = (port.rxData >> 1) | (bit ? 0x80 : 0x00);
+      port.rxBits++;
+      OCR1B += BIT_TICKS;
+      return;
+    }
+
+    // Stop bit, bytes with a framing error are dropped
+    if (bit) {
+      port.rxBuffer.push(port.rxData);
+    }
+    stopReceiver();
+  }
+
+  /// Sends the next bit (compare C interrupt).
+  static void onTransmitTimer() {
+    auto &port = getPort();
+    if (isLate(OCR1C)) {
+      if (port.txBits) {
+        // A bit was stretched, so the receiver sees garbage. Idle for a
+        // frame to let it resynchronize and send the byte again.
+        port.tx.setHigh();
+        port.txBits = 0u;
+        port.txRetry = true;
+        OCR1C = Timer::now() + FRAME_TICKS;
+        return;
+      }
+      // Only the stop bit was stretched, which is harmless
+      OCR1C = Timer::now();
+    }
+    OCR1C += BIT_TICKS;
+    if (!port.txBits) {
+      auto value = port.txValue;
+      if (port.txHold || !(port.txRetry || port.txBuffer.pop(value))) {
+        TIMSK1 &= ~_BV(OCIE1C);
+        return;
+      }
+      // Start bit, 8 data bits and stop bit, LSB first
+      port.txValue = value;
+      port.txRetry = false;
+      port.txFrame = uint16_t(value) << 1 | 0x200;
+      port.txBits = 10u;
+    }
+    port.tx.set(port.txFrame & 1u);
+    port.txFrame >>= 1;
+    port.txBits--;
+  }
+
+private:
+  static const int RX_PIN{GamePort<15>::pin};
+  static const int TX_PIN{GamePort<12>::pin};
+  static_assert(pinPort(RX_PIN) == 0, "MIDI IN has to be on port B for the pin change interrupt");
+
+  static constexpr Timer::Ticks BIT_TICKS = Timer::fromMicros(1000000ul / BAUD_RATE);
+  static constexpr Timer::Ticks FRAME_TICKS = 10u * BIT_TICKS;
+
+  /// Delay of a compare interrupt, after which the bit timing is lost.
+  static constexpr Timer::Ticks LATE_TICKS = BIT_TICKS / 2u;
+
+  struct Port {
+    DigitalOutput<TX_PIN> tx;
+    RingBuffer<64> rxBuffer;
+    RingBuffer<64> txBuffer;
+    uint8_t rxBits{};
+    uint8_t rxData{};
+    volatile uint8_t txBits{};
+    uint16_t txFrame{};
+    uint8_t txValue{};
+    bool txRetry{};
+    volatile bool txHold{};
+    uint8_t txStatus{};
+  };
+
+  /// Checks, if a compare interrupt came too late, because it was
+  /// blocked by the protocols or other interrupts. Otherwise the next
+  /// compare value could already be passed and match only after the
+  /// timer wrapped around.
+  static bool isLate(Timer::Ticks compare) {
+    return Timer::since(compare) > LATE_TICKS;
+  }
+
+  /// Starts the transmission, if the transmitter is idle.
+  static void startTransmitter() {
+    const InterruptStopper noirq;
+    if (!(TIMSK1 & _BV(OCIE1C))) {
+      OCR1C = Timer::now() + BIT_TICKS;
+      TIFR1 = _BV(OCF1C);
+      TIMSK1 |= _BV(OCIE1C);
+    }
+  }
+
+  /// Stops the bit timer and waits for the next start bit.
+  static void stopReceiver() {
+    TIMSK1 &= ~_BV(OCIE1B);
+    PCIFR = _BV(PCIF0);
+    PCMSK0 |= _BV(pinBit(RX_PIN));
+  }
+
+  /// Finishes the current byte before the protocols stop the interrupts
+  /// and holds back the next ones until the interrupts are back.
+  static void onLongInterruptStop(bool stopping) {
+    auto &port = getPort();
+    if (stopping) {
+      port.txHold = true;
+      const auto start = Timer::now();
+      while (port.txBits && Timer::since(start) < FRAME_TICKS) {
+      }
+    } else {
+      port.txHold = false;
+      startTransmitter();
+    }
+  }
+
+  static Port &getPort() {
+    static Port port;
+    return port;
+  }
+};
+
+ISR(PCINT0_vect) {
+  MidiPort::onStartBit();
+}
+
+ISR(TIMER1_COMPB_vect) {
+  MidiPort::onReceiveTimer();
+}
+
+ISR(TIMER1_COMPC_vect) {
+  MidiPort::onTransmitTimer();
+}
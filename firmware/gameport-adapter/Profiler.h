@@ -0,0 +1,206 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HidDevice.h"
+#include "Timer.h"
+#include "Utilities.h"
+
+/// Latency profiler.
+///
+/// Collects the durations of the processing stages between the game port
+/// and the USB wire in Timer ticks. Every stage keeps min, max, mean and a
+/// histogram with power of two buckets, starting at 16 ticks (8us). The
+/// statistics can be read by the host with a HID feature report, so
+/// production units can be profiled without a serial console. Additionally
+/// the startup milestones are recorded in milliseconds since power-on.
+class Profiler {
+public:
+  /// Processing stages.
+  enum class Stage : uint8_t {
+    /// Reading the raw data from the game port.
+    acquire,
+
+    /// Decoding the raw data into the joystick state.
+    decode,
+
+    /// Packing the state into the HID report.
+    pack,
+
+    /// Sending the HID report, including the wait for the host.
+    send,
+
+    /// The whole update cycle.
+    total,
+  };
+
+  static const uint8_t NUM_STAGES{5};
+  static const uint8_t NUM_BUCKETS{12};
+
+  /// Startup milestones.
+  enum class Milestone : uint8_t {
+    /// The device was detected and the HID descriptor is ready.
+    probed,
+
+    /// The host has configured the USB device.
+    configured,
+
+    /// The first valid report was sent to the host.
+    first_report,
+  };
+
+  static const uint8_t NUM_MILESTONES{3};
+
+  /// Measures the time of a scope (RAII).
+  class Probe {
+  public:
+    explicit Probe(Stage stage)
+    : m_stage(stage)
+    , m_start(Timer::now()) {
+    }
+
+    ~Probe() {
+      record(m_stage, Timer::since(m_start));
+    }
+
+    Probe(const Probe &) = delete;
+    Probe(Probe &&) = delete;
+    Probe &operator=(const Probe &) = delete;
+    Probe &operator=(Probe &&) = delete;
+
+  private:
+    const Stage m_stage;
+    const Timer::Ticks m_start;
+  };
+
+  /// Measures the duration of the given function.
+  /// @returns the result of the function
+  template <typename T>
+  static auto measure(Stage stage, T &&function) -> decltype(function()) {
+    const Probe probe(stage);
+    return function();
+  }
+
+  /// Records the time of a milestone.
+  ///
+  /// Only the first occurrence is recorded, so this function can be
+  /// called on every update.
+  static void mark(Milestone milestone) {
+    auto &time = getMilestones()[uint8_t(milestone)];
+    if (!time) {
+      // The milestones are read by the host from the USB interrupt
+      const InterruptStopper noirq;
+      time = max(millis(), 1ul);
+    }
+  }
+
+  /// Records a duration of a stage.
+  static void record(Stage stage, Timer::Ticks ticks) {
+    // The statistics are read by the host from the USB interrupt
+    const InterruptStopper noirq;
+    auto &stats = getStats()[uint8_t(stage)];
+
+    if (ticks < stats.min) {
+      stats.min = ticks;
+    }
+    if (ticks > stats.max) {
+      stats.max = ticks;
+    }
+
+    // Halve the sums instead of overflowing, the mean stays the same
+    if (stats.count == 0xffff) {
+      stats.count >>= 1;
+      stats.sum >>= 1;
+    }
+    stats.count++;
+    stats.sum += ticks;
+
+    uint8_t bucket = 0u;
+    for (auto value = ticks >> 4; value && bucket < NUM_BUCKETS - 1; value >>= 1) {
+      bucket++;
+    }
+    if (++stats.histogram[bucket] == 0xff) {
+      for (auto &value : stats.histogram) {
+        value >>= 1;
+      }
+    }
+  }
+
+  /// HID feature report with the statistics.
+  ///
+  /// The report starts with the format version, the number of Timer
+  /// ticks per microsecond and the startup milestones in milliseconds as
+  /// 16 bit little endian values (0 if not reached yet). It is followed by
+  /// every stage with min, max, mean and count as 16 bit little endian
+  /// values and the histogram buckets as 8 bit values.
+  class Report : public VendorFeature {
+  public:
+    static const uint8_t ID{0x10};
+
+    Report()
+    : VendorFeature(ID, HEADER_SIZE + NUM_STAGES * STAGE_SIZE) {
+    }
+
+    int send() override {
+      const uint8_t header[] = {VERSION, Timer::TICKS_PER_US};
+      auto total = USB_SendControl(0, header, sizeof(header));
+      const auto res = USB_SendControl(0, getMilestones(), sizeof(MilestoneArray));
+      if (total < 0 || res < 0) {
+        return -1;
+      }
+      total += res;
+      for (const auto &stats : getStats()) {
+        const uint16_t values[] = {stats.count ? stats.min : uint16_t(0u), stats.max, stats.count ? uint16_t(stats.sum / stats.count) : uint16_t(0u), stats.count};
+        const auto res1 = USB_SendControl(0, values, sizeof(values));
+        const auto res2 = USB_SendControl(0, stats.histogram, sizeof(stats.histogram));
+        if (res1 < 0 || res2 < 0) {
+          return -1;
+        }
+        total += res1 + res2;
+      }
+      return total;
+    }
+
+  private:
+    static const uint8_t VERSION{2};
+    static const uint8_t HEADER_SIZE{2 + NUM_MILESTONES * sizeof(uint16_t)};
+    static const uint8_t STAGE_SIZE{4 * sizeof(uint16_t) + NUM_BUCKETS};
+  };
+
+private:
+  struct Stats {
+    uint16_t min{0xffff};
+    uint16_t max{};
+    uint16_t count{};
+    uint32_t sum{};
+    uint8_t histogram[NUM_BUCKETS]{};
+  };
+
+  using StatsArray = Stats[NUM_STAGES];
+
+  using MilestoneArray = uint16_t[NUM_MILESTONES];
+
+  static MilestoneArray &getMilestones() {
+    static MilestoneArray milestones;
+    return milestones;
+  }
+
+  static StatsArray &getStats() {
+    static StatsArray stats;
+    return stats;
+  }
+};
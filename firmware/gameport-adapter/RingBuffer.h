@@ -0,0 +1,70 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+
+/// Lock free ring buffer of bytes.
+///
+/// Safe for one producer and one consumer, where one of them may run in
+/// an interrupt. The indices are single bytes, which are read and written
+/// atomically on AVR, so no interrupt guard is needed.
+template <uint8_t Size>
+class RingBuffer {
+  static_assert(Size && (Size & (Size - 1u)) == 0u, "Size must be a power of two");
+
+public:
+  /// Appends a byte.
+  /// @returns false if the buffer is full
+  bool push(uint8_t value) {
+    const uint8_t head = m_head;
+    const uint8_t next = (head + 1u) & MASK;
+    if (next == m_tail) {
+      return false;
+    }
+    m_data[head] = value;
+    m_head = next;
+    return true;
+  }
+
+  /// Takes the oldest byte.
+  /// @returns false if the buffer is empty
+  bool pop(uint8_t &value) {
+    const uint8_t tail = m_tail;
+    if (tail == m_head) {
+      return false;
+    }
+    value = m_data[tail];
+    m_tail = (tail + 1u) & MASK;
+    return true;
+  }
+
+  /// Gets the number of bytes, which can be pushed.
+  uint8_t getSpace() const {
+    return (m_tail - m_head - 1u) & MASK;
+  }
+
+  bool isEmpty() const {
+    return m_head == m_tail;
+  }
+
+private:
+  static const uint8_t MASK{Size - 1u};
+  volatile uint8_t m_data[Size]{};
+  volatile uint8_t m_head{};
+  volatile uint8_t m_tail{};
+};
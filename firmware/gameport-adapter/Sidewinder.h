@@ -17,55 +17,79 @@
 #pragma once
 
 #include "Buffer.h"
+#include "Config.h"
+#include "Debouncer.h"
 #include "DigitalPin.h"
+#include "Flash.h"
 #include "Joystick.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "Utilities.h"
 
 /// Class to for communication with Sidewinder joysticks.
 /// @remark This is a green field implementation, but it was heavily
 ///         inspired by Linux Sidewinder driver implementation. See
 ///         https://github.com/torvalds/linux/blob/master/drivers/input/joystick/sidewinder.c
-class Sidewinder : public Joystick {
+class Sidewinder final : public Joystick {
 public:
+  bool needsDetection() const override {
+    return true;
+  }
+
   /// Resets the joystick and tries to detect the model.
   bool init() override {
     log("Sidewinder init...");
-    m_errors = 0;
+    if (!probe()) {
+      return false;
+    }
+    log("Detected model %d", m_model);
+    return true;
+  }
 
-    m_model = guessModel(readPacket());
-    while (m_model == Model::SW_UNKNOWN) {
+  /// Checks if a Sidewinder device is connected.
+  ///
+  /// In contrast to init() this function gives up after one attempt
+  /// to enable the digital mode.
+  /// @returns true if a supported model was detected
+  bool probe() {
+    const Memory::Scratch<Packet> packet;
+    readPacket(*packet);
+    m_model = guessModel(*packet);
+    if (m_model == Model::SW_UNKNOWN) {
       // No data. 3d Pro analog mode?
       enableDigitalMode();
-      m_model = guessModel(readPacket());
+      readPacket(*packet);
+      m_model = guessModel(*packet);
     }
-    log("Detected model %d", m_model);
-    return true;
+    return m_model != Model::SW_UNKNOWN;
   }
 
   bool update() override {
-    const auto packet = readPacket();
+    const Memory::Scratch<Packet> packet;
+    Profiler::measure(Profiler::Stage::acquire, [this, &packet] { readPacket(*packet); });
+    Trace::record(Trace::Source::sidewinder, 0, packet->data, packet->size, 3);
     State state;
-    if (decode(packet, state)) {
-      m_state = state;
-      m_errors = 0;
-      return true;
-    }
-
-    m_errors++;
-    log("Packet decoding failed %d time(s)", m_errors);
-    if (m_errors > 5) {
-      return init();
+    if (!Profiler::measure(Profiler::Stage::decode, [&] { return decode(*packet, state); })) {
+      log("Packet decoding failed");
+      Trace::error();
+      return false;
     }
-    return false;
+    state.buttons = m_debouncer.update(state.buttons);
+    m_state = state;
+    return true;
   }
 
   const State &getState() const override {
     return m_state;
   }
 
-  const Description &getDescription() const override;
+  Description getDescription() const override;
 
 private:
+  /// Replays recorded packets on the host, see firmware/tests.
+  friend class TraceReplay;
+
   /// Supported Sidewinder model types.
   enum class Model {
     /// Unknown model.
@@ -93,25 +117,35 @@ private:
   /// Model specific status decoder function.
   template <Model M>
   struct Decoder {
-    static const Description &getDescription();
+    static Description getDescription();
     static bool decode(const Packet &packet, State &state);
   };
 
   /// Guesses joystick model from the size of the packet.
   Model guessModel(const Packet &packet) const {
     log("Guessing model by packet size of %d", packet.size);
-    switch (packet.size) {
+    const auto model = getModel(packet.size);
+    if (model == Model::SW_PRECISION_PRO) {
+      const auto id = readID(packet.size);
+      log("Data packet size is ambiguous. Guessing by ID %d", id);
+      if (id == 14) {
+        return Model::SW_FORCE_FEEDBACK_PRO;
+      }
+    }
+    return model;
+  }
+
+  /// Gets the model by the packet size alone.
+  ///
+  /// The Force Feedback Pro sends the same packets as the Precision Pro,
+  /// so it is reported as Precision Pro.
+  static Model getModel(uint8_t size) {
+    switch (size) {
       case 15:
         return Model::SW_GAMEPAD;
-      case 16:   // 3bit mode
-      case 48: { // 1bit mode
-          const auto id = readID(packet.size);
-          log("Data packet size is ambiguous. Guessing by ID %d", id);
-          if (id == 14) {
-            return Model::SW_FORCE_FEEDBACK_PRO;
-          }
-          return Model::SW_PRECISION_PRO;
-        }
+      case 16: // 3bit mode
+      case 48: // 1bit mode
+        return Model::SW_PRECISION_PRO;
       case 11: // 3bit mode
       case 33: // 1bit mode
         return Model::SW_FORCE_FEEDBACK_WHEEL;
@@ -122,9 +156,15 @@ private:
     }
   }
 
+  /// Waits until the device cooled down since the last read.
+  ///
+  /// Instead of a fixed delay, only the rest of the time since the last
+  /// read is waited, so the time spent on decoding and USB counts.
   void cooldown() const {
+    const unsigned long duration = Config::get().sidewinderCooldown;
     m_trigger.setLow();
-    delay(3);
+    while (micros() - m_lastRead < duration)
+      ;
   }
 
   void trigger() const {
@@ -132,13 +172,12 @@ private:
   }
 
   DigitalInput<GamePort<2>::pin, true> m_clock;
-  DigitalInput<GamePort<7>::pin, true> m_data0;
-  DigitalInput<GamePort<10>::pin, true> m_data1;
-  DigitalInput<GamePort<14>::pin, true> m_data2;
+  PinGroup<GamePort<7>::pin, GamePort<10>::pin, GamePort<14>::pin> m_data;
   DigitalOutput<GamePort<3>::pin> m_trigger;
   Model m_model{Model::SW_UNKNOWN};
   State m_state{};
-  uint8_t m_errors{};
+  Debouncer<> m_debouncer;
+  mutable unsigned long m_lastRead{};
 
   /// Enables digital mode for 3D Pro.
   //
@@ -150,24 +189,24 @@ private:
     static const uint16_t seq[] = {magic, magic + 725, magic + 300, magic, 0};
     log("Trying to enable digital mode");
     cooldown();
-    const InterruptStopper interruptStopper;
+    const LongInterruptStopper interruptStopper;
     for (auto i = 0u; seq[i]; i++) {
       trigger();
       delayMicroseconds(seq[i]);
     }
+    m_lastRead = micros();
   }
 
   /// Read bits packet from the joystick.
   ///
   /// This part is extremely performance and timing critical. Change only, if
   /// you know, what you are doing.
-  Packet readPacket() const {
+  void readPacket(Packet &packet) const {
 
     // Packet instantiation is a very expensive call, which zeros the memory.
-    // The instantiation should therefore happen outside of the interrupt stopper
-    // and before triggering the device. Otherwise the clock will come before
-    // the packet was zeroed/instantiated.
-    Packet packet;
+    // The packet is therefore provided by the caller, so the instantiation
+    // happens outside of the interrupt stopper and before triggering the
+    // device. Otherwise the clock will come before the packet was zeroed.
 
     // We are reading into a byte array instead of an uint64_t, because of two
     // reasons. First, bits packets can be larger, than 64 bits. We are actually
@@ -177,13 +216,8 @@ private:
     // impossible to do in time. Unfortunately this shift is extremely slow on
     // an Arduino and it's just faster to write into an array. One bit per byte.
     packet.size = readBits(Packet::MAX_SIZE, [this, &packet](uint8_t pos) {
-      const auto b1 = m_data0.read();
-      const auto b2 = m_data1.read();
-      const auto b3 = m_data2.read();
-      packet.data[pos] = bool(b1) | bool(b2) << 1 | bool(b3) << 2;
+      packet.data[pos] = m_data.read();
     });
-
-    return packet;
   }
 
   uint8_t readID(uint8_t dataPacketSize) const {
@@ -204,17 +238,24 @@ private:
 
   template <typename T>
   uint8_t readBits(uint8_t maxCount, T&& extract) const {
-    static const uint8_t wait_duration = 100;
+    // Timeouts in microseconds, by default the same as SW_START and
+    // SW_STROBE in the Linux driver. The first bit may take longer after
+    // the trigger.
+    const auto start_duration = Config::get().sidewinderStart;
+    const auto strobe_duration = Config::get().sidewinderStrobe;
     uint8_t count{};
     cooldown();
     // WARNING: Here starts the timing critical section
-    const InterruptStopper interruptStopper;
+    const LongInterruptStopper interruptStopper;
     trigger();
-    if (m_clock.wait(true, wait_duration)) {
+    if (m_clock.wait(true, start_duration)) {
+      auto wait_duration = start_duration;
       while(count < maxCount && m_clock.wait(Edge::rising, wait_duration)) {
         extract(count++);
+        wait_duration = strobe_duration;
       }
     }
+    m_lastRead = micros();
     return count;
   }
 
@@ -226,9 +267,10 @@ private:
 template <>
 class Sidewinder::Decoder<Sidewinder::Model::SW_UNKNOWN> {
 public:
-  static const Description &getDescription() {
-    static const Description desc{"Unknown", 0, 0, 0};
-    return desc;
+  static Description getDescription() {
+    static const char name[] PROGMEM = "Unknown";
+    static const Description desc PROGMEM{name, 0, 0, 0, {}};
+    return Flash::read(desc);
   }
 
   static bool decode(const Packet &, State &) {
@@ -240,9 +282,10 @@ public:
 template <>
 class Sidewinder::Decoder<Sidewinder::Model::SW_GAMEPAD> {
 public:
-  static const Description &getDescription() {
-    static const Description desc{"MS Sidewinder GamePad", 2, 10, 0};
-    return desc;
+  static Description getDescription() {
+    static const char name[] PROGMEM = "MS Sidewinder GamePad";
+    static const Description desc PROGMEM{name, 2, 10, 0, {2, 2}};
+    return Flash::read(desc);
   }
 
   static bool decode(const Packet &packet, State &state) {
@@ -266,8 +309,8 @@ public:
     for (auto i = 0u; i < 10; i++) {
       state.buttons |= (~packet.data[i + 4] & 1) << i;
     }
-    state.axes[0] = map(1 + packet.data[3] - packet.data[2], 0, 2, 0, 1023);
-    state.axes[1] = map(1 + packet.data[0] - packet.data[1], 0, 2, 0, 1023);
+    state.axes[0] = 1 + packet.data[3] - packet.data[2];
+    state.axes[1] = 1 + packet.data[0] - packet.data[1];
 
     return true;
   }
@@ -277,9 +320,10 @@ public:
 template <>
 class Sidewinder::Decoder<Sidewinder::Model::SW_3D_PRO> {
 public:
-  static const Description &getDescription() {
-    static const Description desc{"MS Sidewinder 3D Pro", 4, 8, 1};
-    return desc;
+  static Description getDescription() {
+    static const char name[] PROGMEM = "MS Sidewinder 3D Pro";
+    static const Description desc PROGMEM{name, 4, 8, 1, {1023, 1023, 511, 1023}};
+    return Flash::read(desc);
   }
 
   static bool decode(const Packet &packet, State &state) {
@@ -310,7 +354,7 @@ public:
     state.axes[1] = bits(0, 3) << 7 | bits(24, 7);
 
     // bit 35-36 + bit 40-46: z-axis (value 0-511)
-    state.axes[2] = map(bits(35, 2) << 7 | bits(40, 7), 0, 511, 0, 1023);
+    state.axes[2] = bits(35, 2) << 7 | bits(40, 7);
 
     // bit 32-34 + bit 48-54: throttle-axis (value 0-1023)
     state.axes[3] = bits(32, 3) << 7 | bits(48, 7);
@@ -346,9 +390,10 @@ private:
 template <>
 class Sidewinder::Decoder<Sidewinder::Model::SW_PRECISION_PRO> {
 public:
-  static const Description &getDescription() {
-    static const Description desc{"MS Sidewinder Precision Pro", 4, 9, 1};
-    return desc;
+  static Description getDescription() {
+    static const char name[] PROGMEM = "MS Sidewinder Precision Pro";
+    static const Description desc PROGMEM{name, 4, 9, 1, {1023, 1023, 63, 127}};
+    return Flash::read(desc);
   }
 
   static bool decode(const Packet &packet, State &state) {
@@ -391,8 +436,8 @@ public:
 
     state.axes[0] = bits(9, 10);
     state.axes[1] = bits(19, 10);
-    state.axes[2] = map(bits(36, 6), 0, 63, 0, 1023);
-    state.axes[3] = map(bits(29, 7), 0, 127, 0, 1023);
+    state.axes[2] = bits(36, 6);
+    state.axes[3] = bits(29, 7);
     state.hat = bits(42, 4);
     state.buttons = ~bits(0, 9);
 
@@ -405,9 +450,10 @@ public:
 template <>
 class Sidewinder::Decoder<Sidewinder::Model::SW_FORCE_FEEDBACK_PRO> {
 public:
-  static const Description &getDescription() {
-    static const Description desc{"MS Sidewinder Force Feedback Pro", 4, 9, 1};
-    return desc;
+  static Description getDescription() {
+    static const char name[] PROGMEM = "MS Sidewinder Force Feedback Pro";
+    static const Description desc PROGMEM{name, 4, 9, 1, {1023, 1023, 63, 127}};
+    return Flash::read(desc);
   }
 
   static bool decode(const Packet &packet, State &state) {
@@ -420,9 +466,10 @@ public:
 template <>
 class Sidewinder::Decoder<Sidewinder::Model::SW_FORCE_FEEDBACK_WHEEL> {
 public:
-  static const Description &getDescription() {
-    static const Description desc{"MS ForceFeedBack Wheel", 3, 8, 0};
-    return desc;
+  static Description getDescription() {
+    static const char name[] PROGMEM = "MS ForceFeedBack Wheel";
+    static const Description desc PROGMEM{name, 3, 8, 0, {1023, 63, 63}};
+    return Flash::read(desc);
   }
 
   static bool decode(const Packet &packet, State &state) {
@@ -467,10 +514,10 @@ public:
     state.axes[0] = bits(0, 10);
 
     // bit 10-16: Rudder
-    state.axes[1] = map(bits(10, 6), 0, 63, 0, 1023);
+    state.axes[1] = bits(10, 6);
 
     // bit 16-21: Throttle
-    state.axes[2] = map(bits(16, 6), 0, 63, 0, 1023);
+    state.axes[2] = bits(16, 6);
 
     // bit 22-29: buttons 1-8
     state.buttons = ~bits(22, 8);
@@ -479,7 +526,7 @@ public:
   }
 };
 
-inline const Joystick::Description &Sidewinder::getDescription() const {
+inline Joystick::Description Sidewinder::getDescription() const {
   switch (m_model) {
     case Model::SW_GAMEPAD:
       return Decoder<Model::SW_GAMEPAD>::getDescription();
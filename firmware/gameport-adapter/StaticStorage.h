@@ -0,0 +1,99 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <Arduino.h>
+#include <new.h>
+
+/// Statically allocated storage for one object out of a set of types.
+///
+/// The storage is sized and aligned for the largest of the given types at
+/// compile time. This avoids the heap completely, so there is no allocator
+/// code, no fragmentation and the worst case RAM footprint is known at
+/// build time. Creating a new object destroys the previous one.
+template <typename Base, typename... Types>
+class StaticStorage {
+  template <size_t... Values>
+  struct Max {
+    static constexpr size_t value = 0u;
+  };
+
+  template <size_t Value, size_t... Values>
+  struct Max<Value, Values...> {
+    static constexpr size_t value = Value > Max<Values...>::value ? Value : Max<Values...>::value;
+  };
+
+  template <typename T, typename... List>
+  struct Contains {
+    static constexpr bool value = false;
+  };
+
+  template <typename T, typename Head, typename... List>
+  struct Contains<T, Head, List...> {
+    static constexpr bool value = Contains<T, List...>::value;
+  };
+
+  template <typename T, typename... List>
+  struct Contains<T, T, List...> {
+    static constexpr bool value = true;
+  };
+
+public:
+  /// Size of the storage in bytes.
+  static constexpr size_t SIZE = Max<sizeof(Base), sizeof(Types)...>::value;
+
+  /// Alignment of the storage in bytes.
+  static constexpr size_t ALIGN = Max<alignof(Base), alignof(Types)...>::value;
+
+  StaticStorage() = default;
+  ~StaticStorage() {
+    destroy();
+  }
+  StaticStorage(const StaticStorage &) = delete;
+  StaticStorage(StaticStorage &&) = delete;
+  StaticStorage &operator=(const StaticStorage &) = delete;
+  StaticStorage &operator=(StaticStorage &&) = delete;
+
+  /// Creates a new object in the storage.
+  /// @param[in] args are the constructor arguments
+  /// @returns the created object
+  template <typename T, typename... Args>
+  Base *create(Args &&... args) {
+    static_assert(Contains<T, Base, Types...>::value, "Type is not part of the storage");
+    static_assert(sizeof(T) <= SIZE && alignof(T) <= ALIGN, "Type doesn't fit into the storage");
+    destroy();
+    m_object = new (m_data) T(static_cast<Args &&>(args)...);
+    return m_object;
+  }
+
+  /// Destroys the object in the storage.
+  void destroy() {
+    if (m_object) {
+      m_object->~Base();
+      m_object = nullptr;
+    }
+  }
+
+  /// Gets the object in the storage.
+  Base *get() const {
+    return m_object;
+  }
+
+private:
+  alignas(ALIGN) uint8_t m_data[SIZE];
+  Base *m_object{};
+};
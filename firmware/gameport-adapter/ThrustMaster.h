@@ -17,14 +17,17 @@
 #pragma once
 
 #include "AnalogJoystick.h"
+#include "Flash.h"
 #include "Joystick.h"
+#include "Profiler.h"
 
-class ThrustMaster : public Joystick {
+class ThrustMaster final : public Joystick {
 public:
 
-  const Description &getDescription() const override {
-    static const Description description{"ThrustMaster", 3, 4, 1};
-    return description;
+  Description getDescription() const override {
+    static const char name[] PROGMEM = "ThrustMaster";
+    static const Description description PROGMEM{name, 3, 4, 1};
+    return Flash::read(description);
   }
 
   const State &getState() const override {
@@ -32,7 +35,7 @@ public:
   }
 
   bool init() override {
-    return true;
+    return m_joystick.init();
   }
 
   bool update() override {
@@ -60,13 +63,15 @@ public:
       return 0;
     };
 
+    const Profiler::Probe probe(Profiler::Stage::acquire);
+    m_joystick.sampleAxes(0b1111);
     for (auto i = 0u; i < 3; i++) {
       m_state.axes[i] = m_joystick.getAxis(i);
     }
     m_state.hat = hat(m_joystick.getAxis(3));
     m_state.buttons = m_joystick.getButtons();
 
-    return true;
+    return m_joystick.isConnected();
   }
 
 private:
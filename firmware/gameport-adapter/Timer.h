@@ -0,0 +1,75 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Utilities.h"
+#include <Arduino.h>
+
+/// Free running hardware timer.
+///
+/// The Arduino core uses Timer0 for millis() and micros(), but micros()
+/// has only 4us resolution and is too expensive to be called in a polling
+/// loop. Timer1 is only used for PWM on pins, which are not used by the
+/// adapter, so it is reconfigured here as a free running counter with a
+/// prescaler of 8. On a 16MHz MCU one tick is 0.5us and the counter wraps
+/// every 32.768ms. Time differences are calculated with unsigned 16 bit
+/// arithmetic, so they stay valid across the wrap, as long as the measured
+/// time is shorter than one full period. The compare units B and C are
+/// free for interrupt driven timing, see MidiPort.
+struct Timer {
+  using Ticks = uint16_t;
+
+  /// Number of timer ticks per microsecond.
+  static const uint8_t TICKS_PER_US{F_CPU / 8000000UL};
+  static_assert(TICKS_PER_US > 0, "Timer needs at least 8MHz CPU clock");
+
+  /// Longest duration in microseconds, which fits into the ticks.
+  static const uint16_t MAX_MICROS{0xffffu / TICKS_PER_US};
+
+  /// Configures Timer1 as free running counter.
+  static void init() {
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TCCR1C = 0;
+    TIMSK1 = 0;
+  }
+
+  /// Gets the current timestamp.
+  ///
+  /// All the 16 bit registers of the timer share one temporary register
+  /// for the high byte, so the read must not be interrupted by the MIDI
+  /// interrupts, which write the compare registers.
+  static Ticks now() {
+    const InterruptStopper noirq;
+    return TCNT1;
+  }
+
+  /// Gets the ticks passed since the given timestamp.
+  static Ticks since(Ticks timestamp) {
+    return now() - timestamp;
+  }
+
+  /// Converts microseconds to ticks.
+  static constexpr Ticks fromMicros(uint16_t us) {
+    return us * TICKS_PER_US;
+  }
+
+  /// Converts ticks to microseconds.
+  static constexpr uint16_t toMicros(Ticks ticks) {
+    return ticks / TICKS_PER_US;
+  }
+};
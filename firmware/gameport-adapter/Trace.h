@@ -0,0 +1,251 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HidDevice.h"
+#include "Utilities.h"
+#include <Arduino.h>
+
+/// Raw packet trace recorder.
+///
+/// Records the raw packets read from the game port into a ring buffer, so
+/// glitches reported by users can be reproduced by replaying the packets
+/// through the same decoders on the host. The recorder is controlled and
+/// read out with vendor defined HID feature reports. It is turned off by
+/// default and costs just one comparison per packet then.
+///
+/// === Record format ===
+///
+/// Offset Bytes Description
+/// --------------------------------------------------------
+/// 0      2     Timestamp in milliseconds (little endian)
+/// 2      1     Bit 0-3: Source, Bit 4-6: Channel, Bit 7: Decoding failed
+/// 3      1     Bits per entry (W)
+/// 4      1     Number of entries (N)
+/// 5      ?     Entries packed LSB first, (N * W + 7) / 8 bytes
+class Trace {
+public:
+  /// Packet sources.
+  enum class Source : uint8_t {
+    /// Sidewinder packet, 3 bits per clock.
+    sidewinder = 1,
+
+    /// ADI status packet, one bit per entry.
+    adi_status = 2,
+
+    /// ADI metadata packet, one bit per entry.
+    adi_metadata = 3,
+
+    /// GrIP packet word, 8 bits per entry.
+    grip = 4,
+  };
+
+  /// Recording modes.
+  enum class Mode : uint8_t {
+    /// Nothing is recorded.
+    off,
+
+    /// The oldest packets are overwritten by the new ones.
+    continuous,
+
+    /// Same as continuous, but stops on the first decoding failure.
+    stop_on_error,
+
+    /// Stopped after a decoding failure.
+    stopped,
+  };
+
+  /// Records a packet.
+  /// @param[in] source is the source of the packet
+  /// @param[in] channel is the device index for chained devices
+  /// @param[in] data are the packet entries, one per byte
+  /// @param[in] count is the number of entries
+  /// @param[in] width is the number of used bits per entry
+  static void record(Source source, uint8_t channel, const uint8_t *data, uint8_t count, uint8_t width) {
+    auto &ring = getRing();
+    if (ring.mode != Mode::continuous && ring.mode != Mode::stop_on_error) {
+      return;
+    }
+
+    const uint16_t length = HEADER_SIZE + (count * width + 7u) / 8u;
+    if (length > SIZE) {
+      return;
+    }
+
+    // The host reads the buffer from the USB interrupt
+    const InterruptStopper noirq;
+    while (SIZE - ring.used < length) {
+      ring.drop();
+    }
+
+    const auto timestamp = uint16_t(millis());
+    ring.last = ring.tail;
+    ring.put(timestamp);
+    ring.put(timestamp >> 8);
+    ring.put(uint8_t(source) | (channel & 0x07) << 4);
+    ring.put(width);
+    ring.put(count);
+
+    uint8_t bits = 0u;
+    uint8_t used = 0u;
+    for (auto i = 0u; i < count; i++) {
+      for (auto bit = 0u; bit < width; bit++) {
+        bits |= ((data[i] >> bit) & 1u) << used;
+        if (++used == 8u) {
+          ring.put(bits);
+          bits = 0u;
+          used = 0u;
+        }
+      }
+    }
+    if (used) {
+      ring.put(bits);
+    }
+  }
+
+  /// Marks the last recorded packet as failed to decode.
+  static void error() {
+    auto &ring = getRing();
+    if (ring.mode != Mode::continuous && ring.mode != Mode::stop_on_error) {
+      return;
+    }
+
+    const InterruptStopper noirq;
+    if (ring.used) {
+      ring.data[(ring.last + 2u) % SIZE] |= ERROR_FLAG;
+    }
+    if (ring.mode == Mode::stop_on_error) {
+      ring.mode = Mode::stopped;
+    }
+  }
+
+  /// HID feature report to read and change the recording mode.
+  ///
+  /// Setting a recording mode clears the buffer.
+  class ControlReport : public VendorFeature {
+  public:
+    static const uint8_t ID{0x11};
+
+    ControlReport()
+    : VendorFeature(ID, 1) {
+    }
+
+    int send() override {
+      const auto mode = uint8_t(getRing().mode);
+      return USB_SendControl(0, &mode, 1);
+    }
+
+    bool receive(uint16_t length) override {
+      uint8_t data[2];
+      if (length != sizeof(data) || USB_RecvControl(data, sizeof(data)) != sizeof(data)) {
+        return false;
+      }
+      auto &ring = getRing();
+      ring = Ring{};
+      ring.mode = Mode(data[1]);
+      return true;
+    }
+  };
+
+  /// HID feature report with the recorded packets.
+  ///
+  /// The report starts with the format version, the recording mode and
+  /// the number of used bytes, followed by the records from the oldest
+  /// to the newest, padded with zeros.
+  class DataReport : public VendorFeature {
+  public:
+    static const uint8_t ID{0x12};
+
+    DataReport()
+    : VendorFeature(ID, 3 + SIZE) {
+    }
+
+    int send() override {
+      const auto &ring = getRing();
+      const uint8_t header[] = {VERSION, uint8_t(ring.mode), ring.used};
+      int total = 0;
+      if (!sendChunk(header, sizeof(header), total)) {
+        return -1;
+      }
+
+      // Linearize the ring buffer with at most two chunks
+      const auto head = ring.tail >= ring.used ? ring.tail - ring.used : ring.tail + SIZE - ring.used;
+      const auto first = min(uint16_t(ring.used), uint16_t(SIZE - head));
+      if (!sendChunk(ring.data + head, first, total) || !sendChunk(ring.data, ring.used - first, total)) {
+        return -1;
+      }
+
+      static const uint8_t zeros[8]{};
+      for (uint8_t padding = SIZE - ring.used; padding > 0u;) {
+        const auto chunk = min(padding, uint8_t(sizeof(zeros)));
+        if (!sendChunk(zeros, chunk, total)) {
+          return -1;
+        }
+        padding -= chunk;
+      }
+      return total;
+    }
+
+  private:
+    /// Sends a chunk and adds the sent bytes to the total.
+    /// @returns false, if the transfer failed
+    static bool sendChunk(const void *data, uint8_t length, int &total) {
+      const auto res = USB_SendControl(0, data, length);
+      if (res < 0) {
+        return false;
+      }
+      total += res;
+      return true;
+    }
+  };
+
+private:
+  /// Replays recorded packets on the host, see firmware/tests.
+  friend class TraceReplay;
+
+  static const uint8_t VERSION{1};
+  static const uint8_t SIZE{240};
+  static const uint8_t HEADER_SIZE{5};
+  static const uint8_t ERROR_FLAG{0x80};
+
+  struct Ring {
+    uint8_t data[SIZE]{};
+    uint8_t tail{};
+    uint8_t used{};
+    uint8_t last{};
+    Mode mode{Mode::off};
+
+    void put(uint8_t value) {
+      data[tail] = value;
+      tail = (tail + 1u) % SIZE;
+      used++;
+    }
+
+    /// Drops the oldest record.
+    void drop() {
+      const auto head = tail >= used ? tail - used : tail + SIZE - used;
+      const auto width = data[(head + 3u) % SIZE];
+      const auto count = data[(head + 4u) % SIZE];
+      used -= HEADER_SIZE + (count * width + 7u) / 8u;
+    }
+  };
+
+  static Ring &getRing() {
+    static Ring ring;
+    return ring;
+  }
+};
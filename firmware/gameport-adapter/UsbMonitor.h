@@ -0,0 +1,137 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "HidDevice.h"
+#include "Utilities.h"
+
+/// USB polling monitor.
+///
+/// Checks, whether the update loop keeps up with the polling interval,
+/// which is advertised to the host. The USB frame number, which the host
+/// increments every millisecond, is taken at every update cycle, so the
+/// frames passed without fresh data can be counted. Additionally the
+/// endpoint tells, whether the host has polled it in vain since the last
+/// cycle. The counters are free running and can be read by the host with
+/// a HID feature report, so the rates are the differences of two reads.
+class UsbMonitor {
+public:
+  /// Records an update cycle.
+  /// @param[in] interval is the advertised polling interval in frames
+  /// @param[in] polled tells, whether the host has polled in vain before
+  static void cycle(uint8_t interval, bool polled) {
+    const auto frame = getFrame();
+
+    // The counters are read by the host from the USB interrupt
+    const InterruptStopper noirq;
+    auto &counters = getCounters();
+    auto &state = getState();
+    if (state.synced) {
+      const uint16_t elapsed = (frame - state.frame) & FRAME_MASK;
+      counters.frames += elapsed;
+      if (elapsed > interval) {
+        counters.missed += (elapsed - 1u) / interval;
+      }
+    }
+    state.frame = frame;
+    state.synced = true;
+    counters.cycles++;
+    counters.polled += polled;
+  }
+
+  /// Records a report.
+  /// @param[in] sent tells, whether the report was handed to the endpoint
+  static void report(bool sent) {
+    const InterruptStopper noirq;
+    auto &counters = getCounters();
+    counters.reports++;
+    counters.failed += !sent;
+  }
+
+  /// Stops counting the frames until the next cycle.
+  ///
+  /// Has to be called, when the updates stop intentionally, e.g. while
+  /// the device is disconnected. The frame number wraps after 2 seconds.
+  static void pause() {
+    getState().synced = false;
+  }
+
+  /// HID feature report with the counters.
+  ///
+  /// The report starts with the format version and the advertised polling
+  /// interval in milliseconds. It is followed by the number of update
+  /// cycles, the frames passed, the polling intervals without an update
+  /// cycle, the cycles with vain polls of the host before, the reports and
+  /// the failed reports, all as 32 bit little endian values. Vain polls are
+  /// also counted, if the state didn't change and no report was sent.
+  class Report : public VendorFeature {
+  public:
+    static const uint8_t ID{0x15};
+
+    explicit Report(const HidDevice &device)
+    : VendorFeature(ID, HEADER_SIZE + sizeof(Counters))
+    , m_device(device) {
+    }
+
+    int send() override {
+      const uint8_t header[HEADER_SIZE] = {VERSION, m_device.getInterval()};
+      const auto res1 = USB_SendControl(0, header, sizeof(header));
+      const auto res2 = USB_SendControl(0, &getCounters(), sizeof(Counters));
+      if (res1 < 0 || res2 < 0) {
+        return -1;
+      }
+      return res1 + res2;
+    }
+
+  private:
+    static const uint8_t VERSION{1};
+    static const uint8_t HEADER_SIZE{2};
+    const HidDevice &m_device;
+  };
+
+private:
+  /// The USB frame number has 11 bits.
+  static const uint16_t FRAME_MASK{0x7ff};
+
+  struct Counters {
+    uint32_t cycles;
+    uint32_t frames;
+    uint32_t missed;
+    uint32_t polled;
+    uint32_t reports;
+    uint32_t failed;
+  };
+
+  struct State {
+    uint16_t frame;
+    bool synced;
+  };
+
+  static uint16_t getFrame() {
+    return UDFNUM & FRAME_MASK;
+  }
+
+  static Counters &getCounters() {
+    static Counters counters;
+    return counters;
+  }
+
+  static State &getState() {
+    static State state;
+    return state;
+  }
+};
@@ -36,7 +36,16 @@ inline void initLog() {
     while(!Serial); 
 }
 
+/// Runtime switch of the log output.
+inline bool &isLogEnabled() {
+  static bool enabled{true};
+  return enabled;
+}
+
 inline void log(const char *fmt, ...) {
+  if (!isLogEnabled()) {
+    return;
+  }
   va_list args;
   va_start(args, fmt);
   char buffer[512];
@@ -49,13 +58,64 @@ inline void log(const char *fmt, ...) {
 /// Interrupt guard (RAII).
 ///
 /// This class is used to deactivate the interrupts in performance
-/// critical sections. The interrupt is reactivated as soon as this
-/// guard runs out of scope.
+/// critical sections. The previous interrupt state is restored as soon as
+/// this guard runs out of scope, so the guards can be nested and used in
+/// interrupt handlers.
 struct InterruptStopper {
-  InterruptStopper() { noInterrupts(); }
-  ~InterruptStopper() { interrupts(); }
+  InterruptStopper() : m_state(SREG) { noInterrupts(); }
+  ~InterruptStopper() { SREG = m_state; }
   InterruptStopper(const InterruptStopper&) = delete;
   InterruptStopper(InterruptStopper&&) = delete;
   InterruptStopper& operator=(const InterruptStopper&) = delete;
   InterruptStopper& operator=(InterruptStopper&&) = delete;
+
+private:
+  const uint8_t m_state;
+};
+
+/// Interrupt guard for the joystick protocols (RAII).
+///
+/// The protocols keep the interrupts off for up to a few milliseconds,
+/// much longer than a bit of the software serial port. So the registered
+/// handler is called before the interrupts are stopped, to finish the
+/// transfer in progress and to hold back new ones, and again at the end.
+class LongInterruptStopper {
+public:
+  /// Handler of interrupt driven transfers.
+  /// @param[in] stopping is true before the interrupts are stopped and
+  ///            false after they were restored
+  using Handler = void (*)(bool stopping);
+
+  LongInterruptStopper() {
+    if (getHandler()) {
+      getHandler()(true);
+    }
+    m_state = SREG;
+    noInterrupts();
+  }
+
+  ~LongInterruptStopper() {
+    SREG = m_state;
+    if (getHandler()) {
+      getHandler()(false);
+    }
+  }
+
+  LongInterruptStopper(const LongInterruptStopper&) = delete;
+  LongInterruptStopper(LongInterruptStopper&&) = delete;
+  LongInterruptStopper& operator=(const LongInterruptStopper&) = delete;
+  LongInterruptStopper& operator=(LongInterruptStopper&&) = delete;
+
+  /// Sets the handler, there is only one.
+  static void setHandler(Handler handler) {
+    getHandler() = handler;
+  }
+
+private:
+  uint8_t m_state;
+
+  static Handler &getHandler() {
+    static Handler handler;
+    return handler;
+  }
 };
@@ -14,50 +14,110 @@
 // You should have received a copy of the GNU General Public License
 // along with this program. If not, see <https://www.gnu.org/licenses/>.
 
+#include "AutoDetect.h"
 #include "DigitalPin.h"
 #include "HidJoystick.h"
+#include "Memory.h"
+#include "StaticStorage.h"
+#include "Timer.h"
 
 #include "CHFlightstickPro.h"
 #include "CHF16CombatStick.h"
+#include "DualJoystick.h"
 #include "GenericJoystick.h"
 #include "GrIP.h"
 #include "Logitech.h"
 #include "Sidewinder.h"
 #include "ThrustMaster.h"
 
-static Joystick *createJoystick() {
+// Comment the "MIDI_ENABLED" line to remove the USB MIDI interface, which
+// bridges the MIDI pins 12 (OUT) and 15 (IN) of the game port.
+#define MIDI_ENABLED
+
+#ifdef MIDI_ENABLED
+#include "MidiDevice.h"
+
+// Registers itself at the USB core before the enumeration starts,
+// so it must be a global object.
+static MidiDevice midi;
+#endif
+
+/// Does the background work between the joystick updates.
+static void poll() {
+  Config::poll();
+#ifdef MIDI_ENABLED
+  midi.poll();
+#endif
+}
+
+static Driver readSwitches() {
 
   const auto sw1 = DigitalInput<14, true>{};
   const auto sw2 = DigitalInput<15, true>{};
   const auto sw3 = DigitalInput<20, true>{};
   const auto sw4 = DigitalInput<21, true>{};
 
-  // Give some time to setup the input
-  delay(1);
-
-  const auto sw = !sw4 << 3 | !sw3 << 2 | !sw2 << 1 | !sw1;
-
-  switch (sw) {
-    case 0b0001:
-      return new GenericJoystick<2,4>;
-    case 0b0010:
-      return new GenericJoystick<3,4>;
-    case 0b0011:
-      return new GenericJoystick<4,4>;
-    case 0b0100:
-      return new CHFlightstickPro;
-    case 0b0101:
-      return new ThrustMaster;
-    case 0b0110:
-      return new CHF16CombatStick;
-    case 0b0111:
-      return new Sidewinder;
-    case 0b1000:
-      return new GrIP;
-    case 0b1001:
-      return new Logitech;
+  const auto read = [&] {
+    return Driver(!sw4 << 3 | !sw3 << 2 | !sw2 << 1 | !sw1);
+  };
+
+  // The pull-ups need some time to charge the lines. Instead of a fixed
+  // delay, read until two consecutive samples are the same.
+  auto driver = read();
+  for (auto i = 0u; i < 100u; i++) {
+    delayMicroseconds(10);
+    const auto next = read();
+    if (next == driver) {
+      break;
+    }
+    driver = next;
+  }
+  return driver;
+}
+
+static Joystick *createJoystick(Driver driver) {
+
+  // Only one driver is active at a time, so all of them share the same
+  // statically allocated storage instead of the heap.
+  static StaticStorage<Joystick,
+                       GenericJoystick<2,2>,
+                       GenericJoystick<2,4>,
+                       GenericJoystick<3,4>,
+                       GenericJoystick<4,4>,
+                       CHFlightstickPro,
+                       ThrustMaster,
+                       CHF16CombatStick,
+                       Sidewinder,
+                       GrIP,
+                       Logitech,
+                       DualJoystick> storage;
+  static_assert(decltype(storage)::SIZE + sizeof(HidJoystick) <= Memory::DRIVER_BUDGET, "Driver exceeds the RAM budget");
+
+  switch (driver) {
+    case Driver::generic_2_4:
+      return storage.create<GenericJoystick<2,4>>();
+    case Driver::generic_3_4:
+      return storage.create<GenericJoystick<3,4>>();
+    case Driver::generic_4_4:
+      return storage.create<GenericJoystick<4,4>>();
+    case Driver::ch_flightstick_pro:
+      return storage.create<CHFlightstickPro>();
+    case Driver::thrustmaster:
+      return storage.create<ThrustMaster>();
+    case Driver::ch_f16_combat_stick:
+      return storage.create<CHF16CombatStick>();
+    case Driver::sidewinder:
+      return storage.create<Sidewinder>();
+    case Driver::grip:
+      return storage.create<GrIP>();
+    case Driver::logitech:
+      return storage.create<Logitech>();
+    case Driver::dual_2_2:
+      return storage.create<DualJoystick>();
+    case Driver::autodetect:
+      return createJoystick(AutoDetect::detect());
     default:
-      return new GenericJoystick<2,2>;
+      return storage.create<GenericJoystick<2,2>>();
   }
 }
 
@@ -65,15 +125,25 @@ void setup() {
     // DEBUG information: Debugging is turned off by default
     // Comment the "NDEBUG" line in "Utilities.h" to enable logging to the serial monitor
     initLog();
+
+    // The free running timer is used for all the protocol timeouts
+    Timer::init();
+
+#ifdef MIDI_ENABLED
+    // The serial MIDI port runs on the compare units of the timer
+    midi.init();
+#endif
 }
 
 void loop() {
 
-  static auto hidJoystick = [] {
-      HidJoystick hidJoystick;
-      hidJoystick.init(createJoystick());
-      return hidJoystick;
-  }();
+  // HidJoystick registers itself at the USB core, so it must be
+  // constructed in place and never be copied.
+  static HidJoystick hidJoystick;
+  static const auto initialized = hidJoystick.init(createJoystick(readSwitches()));
 
-  hidJoystick.update();
+  if (initialized) {
+    hidJoystick.update();
+  }
+  poll();
 }
@@ -0,0 +1,165 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <random>
+
+#include "AxisFilter.h"
+#include "TraceReplay.h"
+
+// Compares the tunings of the alpha-beta filter on a simulated axis with
+// 3 steps RMS of gaussian noise. The axis rests at 512, ramps to 912 with
+// 2 steps per sample, rests again and finally jumps to 200. The benchmark
+// prints the noise left while resting, the mean error while ramping and
+// the peak overshoot at the end of the ramp and after the jump, which are
+// measured once more without noise.
+//
+// Afterwards the axes of the saved traces are replayed through the filter,
+// by default the ones in the traces directory, otherwise the given ones.
+// For every trace the RMS difference to the samples and the peak overshoot
+// beyond the range of the recent samples are printed.
+
+static const double NOISE{3.0};
+static const int SAMPLES{6000};
+
+/// Number of recent samples, which limit the output of the replayed axes.
+static const size_t WINDOW{8};
+
+static double getTruth(int sample) {
+  if (sample < 2000) {
+    return 512.0;
+  }
+  if (sample < 2200) {
+    return 512.0 + (sample - 2000) * 2.0;
+  }
+  return sample < 4000 ? 912.0 : 200.0;
+}
+
+static void simulate(const AxisFilter::Parameters &params) {
+  std::mt19937 random(1);
+  std::normal_distribution<double> noise(0.0, NOISE);
+  AxisFilter filter;
+  filter.reset(512u);
+
+  auto restSum = 0.0;
+  auto restCount = 0;
+  auto rampSum = 0.0;
+  auto rampCount = 0;
+  for (auto i = 0; i < SAMPLES; i++) {
+    const auto truth = getTruth(i);
+    const auto sample = constrain(lround(truth + noise(random)), 0l, 1023l);
+    const auto error = filter.update(uint16_t(sample), params) - truth;
+    if (i > 500 && i < 2000) {
+      restSum += error * error;
+      restCount++;
+    }
+    if (i > 2050 && i < 2190) {
+      rampSum += error;
+      rampCount++;
+    }
+  }
+
+  filter.reset(512u);
+  auto rampOvershoot = 0.0;
+  auto stepOvershoot = 0.0;
+  for (auto i = 0; i < SAMPLES; i++) {
+    const auto truth = getTruth(i);
+    const auto error = filter.update(uint16_t(truth), params) - truth;
+    if (i >= 2200 && i < 4000) {
+      rampOvershoot = fmax(rampOvershoot, error);
+    }
+    if (i >= 4000) {
+      stepOvershoot = fmax(stepOvershoot, -error);
+    }
+  }
+  printf("alpha %3u beta %2u lag %2u: noise %.2f RMS, ramp error %+.2f, overshoot after ramp %.0f and step %.0f\n",
+         params.alpha, params.beta, params.maxLag, sqrt(restSum / restCount), rampSum / rampCount, rampOvershoot,
+         stepOvershoot);
+}
+
+/// Collects the axes of the decoded packets, one sequence per axis.
+static bool loadAxes(const char *path, std::vector<std::vector<uint16_t>> &axes) {
+  const auto trace = TraceReplay::load(path);
+  TraceReplay replay;
+  return TraceReplay::parse(trace.data(), trace.size(), [&](const TraceReplay::Record &record) {
+    Joystick::State state;
+    if (replay.replay(record, state) != TraceReplay::Result::decoded ||
+        record.source == Trace::Source::adi_metadata) {
+      return;
+    }
+    const auto numAxes = replay.getDescription().numAxes;
+    if (axes.size() < numAxes) {
+      axes.resize(numAxes);
+    }
+    for (auto i = 0u; i < numAxes; i++) {
+      axes[i].push_back(state.axes[i]);
+    }
+  });
+}
+
+static void replay(const std::vector<std::vector<uint16_t>> &axes, const AxisFilter::Parameters &params) {
+  auto sum = 0.0;
+  auto count = 0u;
+  auto overshoot = 0;
+  for (const auto &samples : axes) {
+    AxisFilter filter;
+    if (!samples.empty()) {
+      filter.reset(samples[0]);
+    }
+    for (auto i = 0u; i < samples.size(); i++) {
+      const auto value = int(filter.update(samples[i], params));
+      int low = samples[i];
+      int high = samples[i];
+      for (auto j = i < WINDOW ? 0u : i + 1u - WINDOW; j < i; j++) {
+        low = min(low, int(samples[j]));
+        high = max(high, int(samples[j]));
+      }
+      overshoot = max(overshoot, max(value - high, low - value));
+      sum += (value - samples[i]) * (value - samples[i]);
+      count++;
+    }
+  }
+  printf("  alpha %3u beta %2u lag %2u: error %.2f RMS, overshoot %d\n", params.alpha, params.beta, params.maxLag,
+         count ? sqrt(sum / count) : 0.0, overshoot);
+}
+
+int main(int argc, char *argv[]) {
+  const AxisFilter::Parameters tunings[] = {
+    {0u, 0u, 0u},     {32u, 1u, 64u}, {48u, 2u, 64u}, {64u, 4u, 64u},
+    {64u, 8u, 64u},   {96u, 8u, 64u}, {128u, 16u, 64u}, {96u, 4u, 32u},
+    {48u, 2u, 32u},   {48u, 2u, 16u}, {32u, 1u, 16u},
+  };
+  for (const auto &params : tunings) {
+    simulate(params);
+  }
+
+  auto paths = argc > 1 ? std::vector<std::string>(argv + 1, argv + argc) : TraceReplay::find();
+  auto result = 0;
+  for (const auto &path : paths) {
+    std::vector<std::vector<uint16_t>> axes;
+    if (!loadAxes(path.c_str(), axes)) {
+      printf("%s: malformed trace\n", path.c_str());
+      result = 1;
+      continue;
+    }
+    printf("%s: %zu samples per axis\n", path.c_str(), axes.empty() ? size_t(0) : axes[0].size());
+    for (const auto &params : tunings) {
+      replay(axes, params);
+    }
+  }
+  return result;
+}
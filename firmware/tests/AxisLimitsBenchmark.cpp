@@ -0,0 +1,152 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "AxisLimits.h"
+
+// Simulates 30 minutes of play with a 10 bit axis sampled at 500 Hz. The
+// stick mostly moves within 60% of its range and is pulled to the end
+// every 2 minutes. A single sample spike appears every 2 seconds and a
+// burst of 3, which gets confirmed as an extreme, after 10 minutes. The
+// benchmark prints how far a full deflection is mapped below the range
+// end and how long the burst stays in the limits.
+
+static const uint16_t INNER_MIN{256u};
+static const uint16_t INNER_MAX{768u};
+static const uint16_t TRUE_MIN{40u};
+static const uint16_t TRUE_MAX{980u};
+static const uint32_t RATE{500u};
+static const uint32_t DURATION{30u * 60u * RATE};
+static const uint32_t GLITCH_AT{10u * 60u * RATE};
+static const uint16_t GLITCH_VALUE{1020u};
+
+/// The previous implementation, which decayed every unreached limit.
+class DecayingLimits {
+public:
+  void reset(uint16_t min, uint16_t max) {
+    m_min = min;
+    m_max = max;
+  }
+
+  bool update(uint16_t value, uint16_t innerMin, uint16_t innerMax) {
+    auto changed = false;
+    if (value < m_min || value > m_max) {
+      const bool above = value > m_max;
+      if (m_count == 0u || above != m_above) {
+        m_count = 0u;
+        m_above = above;
+        m_pending = value;
+      } else {
+        m_pending = above ? min(m_pending, value) : max(m_pending, value);
+      }
+      if (++m_count >= 3u) {
+        (above ? m_max : m_min) = m_pending;
+        m_count = 0u;
+        changed = true;
+      }
+    } else {
+      m_count = 0u;
+    }
+    m_reachedMin |= value <= m_min;
+    m_reachedMax |= value >= m_max;
+    if (++m_samples >= 64u) {
+      if (!m_reachedMin && m_min < innerMin) {
+        m_min++;
+        changed = true;
+      }
+      if (!m_reachedMax && m_max > innerMax) {
+        m_max--;
+        changed = true;
+      }
+      m_reachedMin = m_reachedMax = false;
+      m_samples = 0u;
+    }
+    return changed;
+  }
+
+  uint16_t clamp(uint16_t value) const {
+    return value < m_min ? m_min : value > m_max ? m_max : value;
+  }
+
+  uint16_t getMin() const {
+    return m_min;
+  }
+
+  uint16_t getMax() const {
+    return m_max;
+  }
+
+private:
+  uint16_t m_min{}, m_max{}, m_pending{};
+  uint8_t m_count{}, m_samples{};
+  bool m_above{}, m_reachedMin{}, m_reachedMax{};
+};
+
+/// Gets the stick position of a sample.
+static uint16_t getSample(uint32_t index, uint16_t &position) {
+  if (index % (120u * RATE) < RATE) {
+    position = (index / (120u * RATE)) % 2u ? TRUE_MIN : TRUE_MAX;
+  } else if (index % (RATE / 4u) == 0u) {
+    position = 512u + rand() % 601 - 300;
+  }
+  if (index >= GLITCH_AT && index < GLITCH_AT + 3u) {
+    return GLITCH_VALUE;
+  }
+  if (index % (2u * RATE) == RATE) {
+    return rand() % 2 ? 1023u : 0u;
+  }
+  return uint16_t(constrain(position + rand() % 7 - 3, 0, 1023));
+}
+
+template <typename Limits>
+static void run(const char *name) {
+  srand(1);
+  Limits limits;
+  limits.reset(INNER_MIN, INNER_MAX);
+  uint16_t position = 512u;
+  auto changes = 0u;
+  auto count = 0u;
+  auto sum = 0.0;
+  auto worst = 0.0;
+  auto glitchEnd = DURATION;
+  for (auto i = 0u; i < DURATION; i++) {
+    const auto sample = getSample(i, position);
+    changes += limits.update(sample, INNER_MIN, INNER_MAX);
+    const auto span = max(limits.getMax() - limits.getMin(), 1);
+    const auto mapped = uint32_t(limits.clamp(sample) - limits.getMin()) * 1023u / span;
+    if (i >= 2u * 120u * RATE && abs(sample - position) <= 3) {
+      const auto expected = (sample - TRUE_MIN) * 1023.0 / (TRUE_MAX - TRUE_MIN);
+      const auto error = fabs(mapped - expected);
+      sum += error;
+      count++;
+      worst = max(worst, error);
+    }
+    if (i >= GLITCH_AT + 3u && glitchEnd == DURATION && limits.getMax() <= TRUE_MAX + 3u) {
+      glitchEnd = i;
+    }
+  }
+  printf("%-14s mapping error mean %5.1f max %5.1f, glitch held %5.1f s, %u limit changes\n", name,
+         sum / count, worst, (glitchEnd - GLITCH_AT) / double(RATE), changes);
+}
+
+int main() {
+  run<DecayingLimits>("decay always");
+  run<AxisLimits>("decay to peak");
+  return 0;
+}
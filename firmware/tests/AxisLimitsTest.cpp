@@ -0,0 +1,92 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "AxisLimits.h"
+#include "Test.h"
+
+// Inner range of a 10 bit axis, like the Logitech devices use it.
+static const uint16_t INNER_MIN{256u};
+static const uint16_t INNER_MAX{768u};
+
+/// Feeds the same sample several times.
+static void feed(AxisLimits &limits, uint16_t value, uint32_t count) {
+  for (auto i = 0u; i < count; i++) {
+    limits.update(value, INNER_MIN, INNER_MAX);
+  }
+}
+
+int main() {
+  // Single spikes and short bursts don't widen the limits.
+  {
+    AxisLimits limits;
+    limits.reset(INNER_MIN, INNER_MAX);
+    feed(limits, 1000u, 1u);
+    feed(limits, 500u, 1u);
+    feed(limits, 1000u, 2u);
+    feed(limits, 500u, 1u);
+    feed(limits, 0u, 2u);
+    CHECK(limits.getMin() == INNER_MIN);
+    CHECK(limits.getMax() == INNER_MAX);
+  }
+
+  // Three samples in a row confirm the least extreme of them.
+  {
+    AxisLimits limits;
+    limits.reset(INNER_MIN, INNER_MAX);
+    CHECK(!limits.update(1000u, INNER_MIN, INNER_MAX));
+    CHECK(!limits.update(950u, INNER_MIN, INNER_MAX));
+    CHECK(limits.update(980u, INNER_MIN, INNER_MAX));
+    CHECK(limits.getMax() == 950u);
+    CHECK(limits.clamp(1000u) == 950u);
+  }
+
+  // Partial deflections don't compress the range, as long as the stick
+  // reaches the limit once in a while.
+  {
+    AxisLimits limits;
+    limits.reset(INNER_MIN, INNER_MAX);
+    for (auto round = 0u; round < 20u; round++) {
+      feed(limits, 1000u, 3u);
+      feed(limits, 20u, 3u);
+      feed(limits, 800u, AxisLimits::PEAK_SAMPLES);
+    }
+    CHECK(limits.getMin() == 20u);
+    CHECK(limits.getMax() == 1000u);
+  }
+
+  // Without full deflections the limits decay slowly, but not any further
+  // than the stick has moved recently.
+  {
+    AxisLimits limits;
+    limits.reset(INNER_MIN, INNER_MAX);
+    feed(limits, 1000u, 3u);
+    feed(limits, 900u, AxisLimits::DECAY_SAMPLES * 10u);
+    CHECK(limits.getMax() >= 990u);
+    feed(limits, 900u, AxisLimits::DECAY_SAMPLES * 200u);
+    CHECK(limits.getMax() == 900u);
+  }
+
+  // A wrongly confirmed extreme fades out, but never into the inner range.
+  {
+    AxisLimits limits;
+    limits.reset(INNER_MIN, INNER_MAX);
+    feed(limits, 800u, 3u);
+    feed(limits, 512u, AxisLimits::DECAY_SAMPLES * 100u);
+    CHECK(limits.getMax() == INNER_MAX);
+  }
+
+  return report("AxisLimitsTest");
+}
@@ -0,0 +1,77 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "CodeFilter.h"
+#include "Test.h"
+
+// Hat codes of the CH FlightStick Pro, the single lines are the buttons.
+static bool isValid(uint8_t code) {
+  static const uint8_t hat[16] = {0, 0, 0, 7, 0, 6, 0, 5, 0, 4, 0, 3, 0, 2, 0, 1};
+  return (code & (code - 1u)) == 0u || hat[code] != 0u;
+}
+
+/// Feeds the samples and checks, that only the expected codes come out.
+template <size_t N>
+static void replay(const uint8_t (&samples)[N], const uint8_t (&expected)[N]) {
+  CodeFilter filter;
+  for (auto i = 0u; i < N; i++) {
+    const auto code = filter.update(samples[i], isValid(samples[i]));
+    if (code != expected[i]) {
+      printf("sample %u: code %u, expected %u\n", i, code, expected[i]);
+    }
+    CHECK(code == expected[i]);
+  }
+}
+
+int main() {
+  // The hat is pressed, the lines 1 and 2 of the code 3 arrive one after
+  // another. The first line must not show up as a button.
+  {
+    const uint8_t samples[] = {0, 1, 3, 3, 3, 0};
+    const uint8_t expected[] = {0, 0, 0, 3, 3, 0};
+    replay(samples, expected);
+  }
+
+  // The hat is pressed diagonally, the code 15 needs two intermediates.
+  {
+    const uint8_t samples[] = {0, 8, 12, 15, 15, 15};
+    const uint8_t expected[] = {0, 0, 0, 0, 15, 15};
+    replay(samples, expected);
+  }
+
+  // The hat is released through another hat code.
+  {
+    const uint8_t samples[] = {0, 15, 15, 7, 0, 0};
+    const uint8_t expected[] = {0, 0, 15, 15, 0, 0};
+    replay(samples, expected);
+  }
+
+  // A real button is accepted after it was stable for two samples.
+  {
+    const uint8_t samples[] = {0, 4, 4, 4, 0};
+    const uint8_t expected[] = {0, 0, 4, 4, 0};
+    replay(samples, expected);
+  }
+
+  // An impossible code is held back, but not longer than the hold limit.
+  {
+    const uint8_t samples[] = {0, 6, 6, 6, 6, 6};
+    const uint8_t expected[] = {0, 0, 0, 0, 6, 6};
+    replay(samples, expected);
+  }
+
+  return report("CodeFilterTest");
+}
@@ -0,0 +1,190 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Logitech.h"
+#include "Sidewinder.h"
+
+#include <glob.h>
+#include <string>
+
+/// Replays a recorded packet trace through the firmware decoders.
+///
+/// The trace is the content of the feature report 0x12, as it is saved by
+/// tools/trace.py. The record format is described in Trace.h. Sidewinder
+/// packets are decoded by the model, which the size of the first packet
+/// stands for. ADI metadata packets initialize the device of the channel,
+/// the following status packets are decoded by it. GrIP words are only
+/// listed, the driver decodes them while reading.
+class TraceReplay {
+public:
+  /// Unpacked record of the trace.
+  struct Record {
+    uint16_t timestamp;
+    Trace::Source source;
+    uint8_t channel;
+    bool failed;
+    uint8_t width;
+    uint8_t count;
+    uint8_t entries[255];
+  };
+
+  /// Result of a replayed record.
+  enum class Result { skipped, decoded, failed };
+
+  /// Unpacks the records of a trace.
+  /// @param[in] report is the content of the feature report without the ID
+  /// @param[in] size is the size of the report
+  /// @param[in] callback is called with every record
+  /// @returns false, if the trace is malformed
+  template <typename T>
+  static bool parse(const uint8_t *report, size_t size, T &&callback) {
+    if (size < 3u || report[0] != Trace::VERSION || size < 3u + report[2]) {
+      return false;
+    }
+    const auto data = report + 3;
+    const size_t used = report[2];
+    size_t offset = 0u;
+    while (offset < used) {
+      if (used - offset < Trace::HEADER_SIZE) {
+        return false;
+      }
+      Record record;
+      record.timestamp = data[offset] | data[offset + 1] << 8;
+      record.source = Trace::Source(data[offset + 2] & 0x0f);
+      record.channel = (data[offset + 2] >> 4) & 0x07;
+      record.failed = data[offset + 2] & Trace::ERROR_FLAG;
+      record.width = data[offset + 3];
+      record.count = data[offset + 4];
+      const size_t length = (record.count * record.width + 7u) / 8u;
+      offset += Trace::HEADER_SIZE;
+      if (record.width > 8u || used - offset < length) {
+        return false;
+      }
+      for (auto i = 0u; i < record.count; i++) {
+        record.entries[i] = 0u;
+        for (auto bit = 0u; bit < record.width; bit++) {
+          const auto pos = i * record.width + bit;
+          record.entries[i] |= ((data[offset + pos / 8u] >> (pos % 8u)) & 1u) << bit;
+        }
+      }
+      offset += length;
+      callback(record);
+    }
+    return true;
+  }
+
+  /// Decodes a record.
+  /// @param[in] record is the recorded packet
+  /// @param[out] state is the decoded state
+  Result replay(const Record &record, Joystick::State &state) {
+    switch (record.source) {
+      case Trace::Source::sidewinder:
+        return replaySidewinder(record, state);
+      case Trace::Source::adi_metadata:
+        return replayMetaData(record);
+      case Trace::Source::adi_status:
+        return replayStatus(record, state);
+      default:
+        return Result::skipped;
+    }
+  }
+
+  /// Reads a trace file.
+  /// @returns the content, which is empty if the file can't be read
+  static std::vector<uint8_t> load(const char *path) {
+    std::vector<uint8_t> data;
+    if (const auto file = fopen(path, "rb")) {
+      uint8_t buffer[256];
+      size_t size;
+      while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0u) {
+        data.insert(data.end(), buffer, buffer + size);
+      }
+      fclose(file);
+    }
+    return data;
+  }
+
+  /// Finds the saved traces in the traces directory.
+  static std::vector<std::string> find() {
+    std::vector<std::string> paths;
+    glob_t found{};
+    if (!glob("traces/*.bin", 0, nullptr, &found)) {
+      paths.assign(found.gl_pathv, found.gl_pathv + found.gl_pathc);
+    }
+    globfree(&found);
+    return paths;
+  }
+
+  /// Gets the description of the device, which decoded the last record.
+  Joystick::Description getDescription() const {
+    return m_description;
+  }
+
+private:
+  Sidewinder m_sidewinder;
+  Logitech::Device m_devices[Logitech::MAX_DEVICES];
+  bool m_initialized[Logitech::MAX_DEVICES]{};
+  Joystick::Description m_description{};
+
+  template <typename Packet>
+  static Packet toPacket(const Record &record) {
+    Packet packet;
+    packet.size = min(record.count, Packet::MAX_SIZE);
+    memcpy(packet.data, record.entries, packet.size);
+    return packet;
+  }
+
+  /// Decodes with the model, which the firmware guesses by the size of
+  /// the first packet. The Precision Pro and the Force Feedback Pro can
+  /// only be told apart by the ID, but they share the decoder.
+  Result replaySidewinder(const Record &record, Joystick::State &state) {
+    const auto packet = toPacket<Sidewinder::Packet>(record);
+    if (m_sidewinder.m_model == Sidewinder::Model::SW_UNKNOWN) {
+      m_sidewinder.m_model = Sidewinder::getModel(packet.size);
+    }
+    Joystick::State decoded{};
+    if (!m_sidewinder.decode(packet, decoded)) {
+      return Result::failed;
+    }
+    state = decoded;
+    m_description = m_sidewinder.getDescription();
+    return Result::decoded;
+  }
+
+  Result replayMetaData(const Record &record) {
+    if (record.channel >= Logitech::MAX_DEVICES) {
+      return Result::failed;
+    }
+    auto &device = m_devices[record.channel];
+    m_initialized[record.channel] = device.init(toPacket<Logitech::Packet>(record));
+    return m_initialized[record.channel] ? Result::decoded : Result::failed;
+  }
+
+  Result replayStatus(const Record &record, Joystick::State &state) {
+    if (record.channel >= Logitech::MAX_DEVICES || !m_initialized[record.channel]) {
+      return Result::skipped;
+    }
+    auto &device = m_devices[record.channel];
+    if (!device.update(toPacket<Logitech::Packet>(record))) {
+      return Result::failed;
+    }
+    state = device.getState();
+    m_description = device.getDescription();
+    return Result::decoded;
+  }
+};
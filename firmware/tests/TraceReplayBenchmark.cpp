@@ -0,0 +1,111 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "TraceReplay.h"
+
+// Replays saved traces through the decoders. Without arguments all the
+// traces in the traces directory are replayed, otherwise the given ones.
+// For every trace the number of records, the failed ones, the records,
+// which failed differently than on the device, and the host time per
+// decoded packet are printed. With -v every decoded state is printed too.
+
+static const auto ROUNDS = 1000u;
+
+static const char *getName(Trace::Source source) {
+  switch (source) {
+    case Trace::Source::sidewinder:
+      return "sidewinder";
+    case Trace::Source::adi_status:
+      return "adi_status";
+    case Trace::Source::adi_metadata:
+      return "adi_metadata";
+    case Trace::Source::grip:
+      return "grip";
+    default:
+      return "unknown";
+  }
+}
+
+static void print(const TraceReplay::Record &record, TraceReplay::Result result, const Joystick::State &state,
+                  const Joystick::Description &description) {
+  static const char *const results[] = {"skipped", "decoded", "failed"};
+  printf("%5u ms %-12s ch%u %-7s%s", record.timestamp, getName(record.source), record.channel,
+         results[int(result)], record.failed ? " (failed on device)" : "");
+  if (result == TraceReplay::Result::decoded && record.source != Trace::Source::adi_metadata) {
+    printf(" axes");
+    for (auto i = 0u; i < description.numAxes; i++) {
+      printf(" %u", state.axes[i]);
+    }
+    printf(" hat %u buttons %04x", state.hat, state.buttons);
+  }
+  printf("\n");
+}
+
+static bool replay(const char *path, bool verbose) {
+  const auto trace = TraceReplay::load(path);
+  auto records = 0u;
+  auto failed = 0u;
+  auto mismatches = 0u;
+  TraceReplay replay;
+  const auto valid = TraceReplay::parse(trace.data(), trace.size(), [&](const TraceReplay::Record &record) {
+    Joystick::State state;
+    const auto result = replay.replay(record, state);
+    records++;
+    failed += result == TraceReplay::Result::failed;
+    mismatches += record.failed != (result == TraceReplay::Result::failed);
+    if (verbose) {
+      print(record, result, state, replay.getDescription());
+    }
+  });
+  if (!valid) {
+    printf("%s: malformed trace\n", path);
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (auto i = 0u; i < ROUNDS; i++) {
+    TraceReplay replay;
+    TraceReplay::parse(trace.data(), trace.size(), [&](const TraceReplay::Record &record) {
+      Joystick::State state;
+      replay.replay(record, state);
+    });
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  printf("%s: %u records, %u failed, %u differ from the device, %.0f ns per record\n", path, records, failed,
+         mismatches, records ? elapsed.count() / ROUNDS / records : 0.0);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  auto verbose = false;
+  std::vector<std::string> paths;
+  for (auto i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    paths = TraceReplay::find();
+  }
+
+  auto result = 0;
+  for (const auto &path : paths) {
+    result |= !replay(path.c_str(), verbose);
+  }
+  return result;
+}
@@ -0,0 +1,139 @@
+// This file is part of Necroware's GamePort adapter firmware.
+// Copyright (C) 2021 Necroware
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+#include "Test.h"
+#include "TraceReplay.h"
+
+#include <vector>
+
+// Records packets with the firmware recorder, reads them back with the
+// feature report and replays them through the decoders.
+
+/// Packet with one bit per entry, the fields are sent MSB first.
+struct AdiPacket {
+  uint8_t data[255]{};
+  uint8_t size{};
+
+  AdiPacket &push(uint16_t value, uint8_t bits) {
+    while (bits--) {
+      data[size++] = (value >> bits) & 1u;
+    }
+    return *this;
+  }
+};
+
+/// Precision Pro packet with 3 bits per entry.
+static void createPrecisionPro(uint16_t x, uint16_t y, uint8_t hat, uint16_t buttons, bool valid,
+                               uint8_t (&data)[16]) {
+  uint64_t value = uint64_t(~buttons & 0x1ffu) | uint64_t(x) << 9 | uint64_t(y) << 19 | uint64_t(hat) << 42;
+  if (__builtin_parityll(value) != valid) {
+    value |= uint64_t(1u) << 47;
+  }
+  for (auto i = 0u; i < 16u; i++) {
+    data[i] = (value >> (i * 3u)) & 7u;
+  }
+}
+
+/// WingMan Extreme Digital with three 10 bit axes, 6 buttons and a hat.
+static AdiPacket createMetaData() {
+  AdiPacket packet;
+  return packet.push(66, 10).push(0, 4).push(0, 4).push(0xc, 4).push(48, 10)
+      .push(3, 4).push(6, 6).push(8, 6).push(0, 6).push(0, 4).push(0, 4).push(0, 4);
+}
+
+static AdiPacket createStatus(uint16_t x, uint8_t buttons, uint8_t hat) {
+  AdiPacket packet;
+  packet.push(0, 4).push(0, 4).push(x, 10).push(512, 10).push(512, 10);
+  for (auto i = 0u; i < 6u; i++) {
+    packet.push((buttons >> i) & 1u, 1);
+  }
+  return packet.push(hat, 4);
+}
+
+static void setMode(Trace::Mode mode) {
+  stubControlOut() = {Trace::ControlReport::ID, uint8_t(mode)};
+  CHECK(Trace::ControlReport().receive(2));
+}
+
+static std::vector<uint8_t> readTrace() {
+  stubControlIn().clear();
+  Trace::DataReport report;
+  CHECK(report.send() == int(stubControlIn().size()));
+  return stubControlIn();
+}
+
+int main() {
+  // Sidewinder packets with the recorded failure of a broken one
+  {
+    setMode(Trace::Mode::continuous);
+    uint8_t data[16];
+    createPrecisionPro(100, 900, 3, 0x101, true, data);
+    Trace::record(Trace::Source::sidewinder, 0, data, 16, 3);
+    createPrecisionPro(100, 900, 3, 0x101, false, data);
+    Trace::record(Trace::Source::sidewinder, 0, data, 16, 3);
+    Trace::error();
+
+    const auto trace = readTrace();
+    TraceReplay replay;
+    std::vector<TraceReplay::Result> results;
+    std::vector<Joystick::State> states;
+    CHECK(TraceReplay::parse(trace.data(), trace.size(), [&](const TraceReplay::Record &record) {
+      CHECK(record.source == Trace::Source::sidewinder);
+      CHECK(record.count == 16u && record.width == 3u);
+      Joystick::State state;
+      results.push_back(replay.replay(record, state));
+      states.push_back(state);
+      CHECK(record.failed == (results.back() == TraceReplay::Result::failed));
+    }));
+    CHECK(results.size() == 2u);
+    CHECK(results[0] == TraceReplay::Result::decoded);
+    CHECK(states[0].axes[0] == 100u && states[0].axes[1] == 900u);
+    CHECK(states[0].hat == 3u && (states[0].buttons & 0x1ffu) == 0x101u);
+  }
+
+  // ADI metadata and status packets of a chained device
+  {
+    setMode(Trace::Mode::continuous);
+    const auto meta = createMetaData();
+    Trace::record(Trace::Source::adi_metadata, 1, meta.data, meta.size, 1);
+    for (auto i = 0u; i < 2u; i++) {
+      const auto status = createStatus(512, 0x21, 3);
+      Trace::record(Trace::Source::adi_status, 1, status.data, status.size, 1);
+    }
+
+    const auto trace = readTrace();
+    TraceReplay replay;
+    auto count = 0u;
+    Joystick::State state;
+    CHECK(TraceReplay::parse(trace.data(), trace.size(), [&](const TraceReplay::Record &record) {
+      CHECK(record.channel == 1u);
+      CHECK(replay.replay(record, state) == TraceReplay::Result::decoded);
+      count++;
+    }));
+    CHECK(count == 3u);
+    CHECK(replay.getDescription().numAxes == 3u && replay.getDescription().numButtons == 6u);
+    CHECK(state.axes[0] >= 510u && state.axes[0] <= 512u);
+    CHECK(state.buttons == 0x21u && state.hat == 3u);
+  }
+
+  // A truncated trace is rejected
+  {
+    const uint8_t trace[] = {1, 1, 8, 0, 0, 1, 3, 16, 0, 0, 0};
+    CHECK(!TraceReplay::parse(trace, sizeof(trace), [](const TraceReplay::Record &) {}));
+  }
+
+  return report("TraceReplayTest");
+}
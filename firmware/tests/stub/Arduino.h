@@ -0,0 +1,197 @@
+// Minimal Arduino environment to build the hardware independent parts of
+// the firmware on the host. The registers are plain memory and the time
+// only passes, when a test advances it.
+
+#pragma once
+
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using byte = uint8_t;
+
+#define F_CPU 16000000UL
+#define PROGMEM
+#define _BV(bit) (1u << (bit))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// Program memory is ordinary memory on the host
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define memcpy_P memcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+
+// Registers of the ATmega32U4, which are used by the firmware
+inline volatile uint8_t *stubRegisters() {
+  static volatile uint8_t registers[256];
+  return registers;
+}
+#define REG8(a) (stubRegisters()[a])
+#define REG16(a) (*(volatile uint16_t *)&stubRegisters()[a])
+
+#define PINB REG8(0x23)
+#define DDRB REG8(0x24)
+#define PORTB REG8(0x25)
+#define PINC REG8(0x26)
+#define DDRC REG8(0x27)
+#define PORTC REG8(0x28)
+#define PIND REG8(0x29)
+#define DDRD REG8(0x2A)
+#define PORTD REG8(0x2B)
+#define PINE REG8(0x2C)
+#define DDRE REG8(0x2D)
+#define PORTE REG8(0x2E)
+#define PINF REG8(0x2F)
+#define DDRF REG8(0x30)
+#define PORTF REG8(0x31)
+#define TIFR1 REG8(0x36)
+#define PCIFR REG8(0x3B)
+#define SP REG16(0x5D)
+#define SREG REG8(0x5F)
+#define PCICR REG8(0x68)
+#define PCMSK0 REG8(0x6B)
+#define TIMSK1 REG8(0x6F)
+#define ADC REG16(0x78)
+#define ADCSRA REG8(0x7A)
+#define ADCSRB REG8(0x7B)
+#define ADMUX REG8(0x7C)
+#define TCCR1A REG8(0x80)
+#define TCCR1B REG8(0x81)
+#define TCCR1C REG8(0x82)
+#define TCNT1 REG16(0x84)
+#define ICR1 REG16(0x86)
+#define OCR1B REG16(0x8A)
+#define OCR1C REG16(0x8C)
+#define UDCON REG8(0xE0)
+#define UDFNUM REG16(0xE4)
+#define UEINTX REG8(0xE8)
+#define UENUM REG8(0xE9)
+
+#define TOV1 0
+#define OCF1B 2
+#define OCF1C 3
+#define ICF1 5
+#define OCIE1B 2
+#define OCIE1C 3
+#define ICIE1 5
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define ICES1 6
+#define ICNC1 7
+#define PCIE0 0
+#define PCIF0 0
+#define PCINT5 5
+#define PB5 5
+#define PC6 6
+#define ADSC 6
+#define DETACH 0
+#define NAKINI 6
+#define RAMSTART 0x100
+#define RAMEND 0xAFF
+
+#define A0 18
+#define A1 19
+#define A6 24
+#define A7 25
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define NOT_A_PORT 0
+
+#define ISR(vector) extern "C" void vector()
+#define TIMER1_COMPB_vect __vector_18
+#define TIMER1_COMPC_vect __vector_19
+#define PCINT0_vect __vector_9
+
+// All the pins are mapped to the port B
+inline uint8_t digitalPinToBitMask(int pin) {
+  return _BV(pin & 7);
+}
+
+inline uint8_t digitalPinToPort(int) {
+  return 2u;
+}
+
+inline volatile uint8_t *portInputRegister(uint8_t) {
+  return &PINB;
+}
+
+inline volatile uint8_t *portOutputRegister(uint8_t) {
+  return &PORTB;
+}
+
+inline volatile uint8_t *portModeRegister(uint8_t) {
+  return &DDRB;
+}
+
+inline void pinMode(uint8_t, uint8_t) {
+}
+
+inline int analogRead(uint8_t) {
+  return 512;
+}
+
+inline void noInterrupts() {
+}
+
+inline void interrupts() {
+}
+
+inline void cli() {
+}
+
+inline void sei() {
+}
+
+/// Host time in microseconds.
+inline unsigned long &stubMicros() {
+  static unsigned long now;
+  return now;
+}
+
+inline unsigned long micros() {
+  return stubMicros();
+}
+
+inline unsigned long millis() {
+  return stubMicros() / 1000u;
+}
+
+inline void delayMicroseconds(unsigned int us) {
+  stubMicros() += us;
+}
+
+inline void delay(unsigned long ms) {
+  stubMicros() += ms * 1000u;
+}
+
+struct SerialStub {
+  void begin(long) {
+  }
+  explicit operator bool() const {
+    return true;
+  }
+  void println(const char *) {
+  }
+};
+
+static SerialStub Serial __attribute__((unused));
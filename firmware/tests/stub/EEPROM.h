@@ -0,0 +1,26 @@
+// EEPROM of the Arduino environment, which keeps nothing.
+
+#pragma once
+
+#include <Arduino.h>
+
+struct EEPROMStub {
+  uint8_t read(int) const {
+    return 0xff;
+  }
+
+  void update(int, uint8_t) {
+  }
+
+  template <typename T>
+  T &get(int, T &value) {
+    return value;
+  }
+
+  template <typename T>
+  const T &put(int, const T &value) {
+    return value;
+  }
+};
+
+static EEPROMStub EEPROM __attribute__((unused));
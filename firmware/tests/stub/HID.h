@@ -0,0 +1,28 @@
+// HID definitions of the Arduino environment.
+
+#pragma once
+
+#include <PluggableUSB.h>
+
+#define HID_GET_REPORT 0x01
+#define HID_GET_IDLE 0x02
+#define HID_GET_PROTOCOL 0x03
+#define HID_SET_REPORT 0x09
+#define HID_SET_IDLE 0x0A
+#define HID_SET_PROTOCOL 0x0B
+#define HID_REPORT_DESCRIPTOR_TYPE 0x22
+#define HID_SUBCLASS_NONE 0
+#define HID_PROTOCOL_NONE 0
+#define HID_REPORT_PROTOCOL 1
+#define HID_REPORT_TYPE_INPUT 1
+#define HID_REPORT_TYPE_OUTPUT 2
+#define HID_REPORT_TYPE_FEATURE 3
+#define USB_DEVICE_CLASS_HUMAN_INTERFACE 3
+
+struct HIDDescriptor {
+  InterfaceDescriptor hid;
+  uint8_t desc[9];
+  EndpointDescriptor in;
+};
+
+#define D_HIDREPORT(length) {9, 0x21, 0x01, 0x01, 0, 1, 0x22, uint8_t(length), uint8_t((length) >> 8)}
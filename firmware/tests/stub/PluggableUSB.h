@@ -0,0 +1,129 @@
+// USB core of the Arduino environment. Control transfers go to host
+// buffers, so the feature reports can be checked.
+
+#pragma once
+
+#include <Arduino.h>
+
+struct USBSetup {
+  uint8_t bmRequestType;
+  uint8_t bRequest;
+  uint8_t wValueL;
+  uint8_t wValueH;
+  uint16_t wIndex;
+  uint16_t wLength;
+};
+
+struct InterfaceDescriptor {
+  uint8_t data[9];
+};
+
+struct EndpointDescriptor {
+  uint8_t data[7];
+};
+
+#define D_INTERFACE(n, e, c, s, p) {{9, 4, uint8_t(n), 0, e, c, s, p, 0}}
+#define D_ENDPOINT(a, t, s, i) {{7, 5, uint8_t(a), t, uint8_t(s), 0, uint8_t(i)}}
+#define USB_ENDPOINT_IN(a) ((a) | 0x80)
+#define USB_ENDPOINT_OUT(a) (a)
+#define USB_ENDPOINT_TYPE_INTERRUPT 3
+#define USB_ENDPOINT_TYPE_BULK 2
+#define USB_EP_SIZE 64
+#define EP_TYPE_INTERRUPT_IN 0xC1
+#define EP_TYPE_INTERRUPT_OUT 0xC0
+#define EP_TYPE_BULK_IN 0x81
+#define EP_TYPE_BULK_OUT 0x80
+#define TRANSFER_RELEASE 0x40
+#define TRANSFER_PGM 0x80
+#define REQUEST_DEVICETOHOST_STANDARD_INTERFACE 0x81
+#define REQUEST_DEVICETOHOST_CLASS_INTERFACE 0xA1
+#define REQUEST_HOSTTODEVICE_CLASS_INTERFACE 0x21
+
+/// Data sent to the host with control transfers.
+inline std::vector<uint8_t> &stubControlIn() {
+  static std::vector<uint8_t> data;
+  return data;
+}
+
+/// Data sent by the host with the next control transfer.
+inline std::vector<uint8_t> &stubControlOut() {
+  static std::vector<uint8_t> data;
+  return data;
+}
+
+inline int USB_SendControl(uint8_t, const void *data, int length) {
+  const auto bytes = static_cast<const uint8_t *>(data);
+  stubControlIn().insert(stubControlIn().end(), bytes, bytes + length);
+  return length;
+}
+
+inline int USB_RecvControl(void *data, int length) {
+  auto &out = stubControlOut();
+  length = min(length, int(out.size()));
+  memcpy(data, out.data(), length);
+  out.erase(out.begin(), out.begin() + length);
+  return length;
+}
+
+inline int USB_Send(uint8_t, const void *, int length) {
+  return length;
+}
+
+inline int USB_Recv(uint8_t, void *, int) {
+  return 0;
+}
+
+inline int USB_Available(uint8_t) {
+  return 0;
+}
+
+inline uint8_t USB_SendSpace(uint8_t) {
+  return USB_EP_SIZE;
+}
+
+class PluggableUSBModule {
+public:
+  PluggableUSBModule(uint8_t numEps, uint8_t numIfs, uint8_t *epType)
+  : numEndpoints(numEps)
+  , numInterfaces(numIfs)
+  , endpointType(epType) {
+  }
+
+protected:
+  virtual bool setup(USBSetup &) = 0;
+  virtual int getInterface(uint8_t *) = 0;
+  virtual int getDescriptor(USBSetup &) = 0;
+  virtual uint8_t getShortName(char *) {
+    return 0;
+  }
+
+  uint8_t pluggedInterface{};
+  uint8_t pluggedEndpoint{};
+  const uint8_t numEndpoints;
+  const uint8_t numInterfaces;
+  const uint8_t *endpointType;
+  PluggableUSBModule *next{};
+};
+
+struct PluggableUSBStub {
+  bool plug(PluggableUSBModule *) {
+    return true;
+  }
+};
+
+inline PluggableUSBStub &PluggableUSB() {
+  static PluggableUSBStub usb;
+  return usb;
+}
+
+struct USBDeviceStub {
+  bool configured() {
+    return true;
+  }
+  void attach() {
+  }
+  void detach() {
+  }
+};
+
+static USBDeviceStub USBDevice __attribute__((unused));
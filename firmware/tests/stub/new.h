@@ -0,0 +1,3 @@
+// Placement new of the Arduino environment.
+#pragma once
+#include <new>
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# This file is part of Necroware's GamePort adapter firmware.
+# Copyright (C) 2021 Necroware
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+"""Controls the raw packet trace of the adapter and saves the records.
+
+The adapter is accessed through a Linux hidraw device. The saved trace
+is replayed through the firmware decoders by the TraceReplayBenchmark in
+firmware/tests.
+
+  trace.py mode /dev/hidraw0 continuous   start recording
+  trace.py read /dev/hidraw0 dump.bin     save the recorded packets
+"""
+
+import argparse
+import fcntl
+import os
+
+CONTROL_ID = 0x11
+DATA_ID = 0x12
+SIZE = 240
+
+MODES = ['off', 'continuous', 'stop_on_error', 'stopped']
+
+
+def hidiocfeature(nr, length):
+    # _IOC(_IOC_READ | _IOC_WRITE, 'H', nr, length)
+    return 3 << 30 | length << 16 | ord('H') << 8 | nr
+
+
+def get_feature(path, report_id, length):
+    buffer = bytearray([report_id]) + bytearray(length)
+    fd = os.open(path, os.O_RDWR)
+    try:
+        size = fcntl.ioctl(fd, hidiocfeature(0x07, len(buffer)), buffer)
+    finally:
+        os.close(fd)
+    return bytes(buffer[1:size])
+
+
+def set_feature(path, report_id, data):
+    buffer = bytearray([report_id]) + bytearray(data)
+    fd = os.open(path, os.O_RDWR)
+    try:
+        fcntl.ioctl(fd, hidiocfeature(0x06, len(buffer)), buffer)
+    finally:
+        os.close(fd)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+    mode = commands.add_parser('mode', help='read or set the recording mode')
+    mode.add_argument('device')
+    mode.add_argument('mode', nargs='?', choices=MODES[:3])
+    read = commands.add_parser('read', help='save the recorded packets')
+    read.add_argument('device')
+    read.add_argument('output')
+    args = parser.parse_args()
+
+    if args.command == 'mode':
+        if args.mode:
+            set_feature(args.device, CONTROL_ID, [MODES.index(args.mode)])
+        print(MODES[get_feature(args.device, CONTROL_ID, 1)[0]])
+    else:
+        report = get_feature(args.device, DATA_ID, 3 + SIZE)
+        with open(args.output, 'wb') as file:
+            file.write(report)
+        print('%d bytes of records saved' % report[2])
+
+
+if __name__ == '__main__':
+    main()